@@ -29,13 +29,139 @@ typedef void (*grug_init_globals_fn_t)(void *globals, uint64_t id);
 // Returns whether an error occurred
 bool grug_init(grug_runtime_error_handler_t handler, const char *mod_api_json_path, const char *mods_dir_path, const char *dll_dir_path, uint64_t on_fn_time_limit_ms) __attribute__((warn_unused_result));
 
+// Several processes can share the dll directory, like game servers running on the same machine,
+// in which case every grug file is compiled by one process, and the other processes load its dll
+// Directories whose mtime didn't change aren't read again, and the dlls of loaded grug files aren't stat()ed,
+// so manually deleting a loaded dll from the dll directory goes unnoticed until its grug file is modified
 // Returns whether an error occurred
 bool grug_regenerate_modified_mods(void) __attribute__((warn_unused_result));
 
+// These only regenerate a single mod, or a single grug file, like "mods/animals/labrador-Dog.grug",
+// so the rest of the mods directory isn't walked, and the about.json files of the other mods aren't checked
+// Removing the mod or grug file is also handled, by unloading it
+// grug_reloads and grug_resource_reloads are filled just like grug_regenerate_modified_mods() does
+// grug_regenerate_modified_mods() needs to have been called once, before these can be called
+// Returns whether an error occurred
+bool grug_regenerate_mod(const char *mod_name) __attribute__((warn_unused_result));
+bool grug_regenerate_file(const char *grug_path) __attribute__((warn_unused_result));
+
+// Does the same as grug_regenerate_modified_mods(), but spreads the compilation of the grug files over several calls,
+// so the game can keep rendering frames while many grug files are being recompiled
+// Every call compiles grug files until budget_ns nanoseconds have passed, but always compiles at least one
+// is_done is set to false while grug files are left to compile, in which case grug_reloads is empty and the old dlls stay loaded
+// The call that sets is_done to true loads every new dll at once, and fills grug_reloads
+// The grug files are compiled on the calling thread, regardless of grug_set_compilation_thread_count()
+// Calling grug_regenerate_modified_mods(), grug_regenerate_mod() or grug_regenerate_file() in between throws the progress away
+// Returns whether an error occurred
+bool grug_regenerate_modified_mods_step(uint64_t budget_ns, bool *is_done) __attribute__((warn_unused_result));
+
+// Makes grug_regenerate_modified_mods() return right away, while a grug-owned thread compiles the modified grug files
+// A call that sees that the background thread is done loads the compiled dlls and fills grug_reloads,
+// after which the background thread immediately starts looking for modified grug files again
+// The other calls leave grug_reloads empty, so the calling thread never waits for the compiler
+// Grug files that were modified after the background thread looked at them keep their old dll until its next pass
+// Only the calling thread may use grug_mods and grug_get_mod_about(), whereas grug_get_entity_file() can be called by any thread,
+// since it reads a copy of the entity index that the call that loads the compiled dlls publishes once it's done
+// Dlls are opened from memory, like grug_enable_in_memory_dlls(true) does, unless grug_enable_jit() was called first
+// grug_regenerate_mod(), grug_regenerate_file() and grug_regenerate_modified_mods_step() can't be used in this mode
+// This has to be called before the first grug_regenerate_modified_mods() call
+// Returns whether an error occurred
+bool grug_enable_background_regeneration(void) __attribute__((warn_unused_result));
+
+// With background regeneration, the dlls of reloaded and removed grug files aren't closed right away
+// Every thread that calls on_ fns should call this regularly, like once per tick, while it isn't inside of an on_ fn,
+// which tells grug that the thread doesn't use anything from the grug files it reloaded before this call anymore
+// Once every registered thread has called this again after a reload, the old dlls get closed,
+// and the grug files that grug_get_entity_file() returned before the reload get freed
+// The first call registers the thread, which fails when 420 threads are already registered,
+// in which case true is returned, and the thread must not call on_ fns
+// grug_error isn't filled in, since the calling thread of grug_regenerate_modified_mods() could be using it
+bool grug_report_quiescent_state(void) __attribute__((warn_unused_result));
+
+// Has to be called by a registered thread before it exits, or when it stops calling on_ fns for good,
+// since the old dlls otherwise never get closed, as grug would keep waiting for the thread to call grug_report_quiescent_state()
+// This frees the thread its slot, so that another thread can register
+void grug_unregister_reader_thread(void);
+
+// Makes grug_regenerate_modified_mods() use inotify, instead of walking and stat()ing every file in the mods directory
+// Calls without any new inotify events then return almost immediately, leaving the loaded mods untouched
+// Note that only the mods directory is watched, so manually deleting files from the dll directory goes unnoticed
+// Returns whether an error occurred
+bool grug_enable_inotify(void) __attribute__((warn_unused_result));
+
+// Makes grug_regenerate_modified_mods() compile the modified grug files on this many threads,
+// after which the calling thread still loads them one by one, in the same order as before
+// 1 is the default, which compiles every grug file on the calling thread
+// 0 uses as many threads as there are online CPU cores
+// Note that every thread allocates several hundred megabytes of virtual memory, but only touches what it uses
+void grug_set_compilation_thread_count(size_t thread_count);
+
+// Makes grug_regenerate_modified_mods() decide whether to recompile a grug file based on a hash of its content,
+// rather than on whether it was modified after its dll, so things like a git checkout don't cause recompilation
+// The hashes are stored in a grug_build_cache.txt file in the dll directory, together with the version of grug
+// and whether grug_enable_optimizations() was called, so updating grug or toggling optimizations recompiles every grug file
+// Every grug file also stores a hash of the parts of mod_api.json that it was compiled against,
+// being its entity type and the game functions it calls, so a changed mod_api.json only recompiles the affected grug files
+// Processes that share the dll directory don't reuse each other's dlls in this mode, so they each compile the grug files
+void grug_enable_build_cache(void);
+
+// Makes grug_regenerate_modified_mods() dlopen() the dlls it generates from memory, using memfd_create()
+// If write_dlls_to_disk is false, nothing is written to the dll directory,
+// which means every grug file gets recompiled after a restart, and that the build cache goes unused
+void grug_enable_in_memory_dlls(bool write_dlls_to_disk);
+
+// Makes grug_regenerate_modified_mods() map the machine code of every grug file into memory itself,
+// filling in the addresses of game functions and grug's runtime functions directly, instead of going through dlopen()
+// Nothing is written to the dll directory, so every grug file gets recompiled after a restart
+// The game still needs to be linked with -rdynamic, since game functions are looked up with dlsym()
+// This has to be called before the first grug_regenerate_modified_mods() call
+void grug_enable_jit(void);
+
+// Makes grug_enable_jit() put the machine code and data of every grug file of a mod into one image per mod,
+// instead of mapping every grug file separately, which costs two mappings and at least two pages per grug file
+// This keeps the number of mappings far below vm.max_map_count, even with tens of thousands of grug files
+// Reloading a grug file only replaces its own bytes in the image of its mod, which other grug files keep running from
+// Every mod reserves 1 GiB of virtual memory, but only touches what its grug files use,
+// and the reservation is released once none of its grug files are loaded anymore, like after the mod was removed
+// This calls grug_enable_jit(), and has to be called before the first grug_regenerate_modified_mods() call
+// Returns whether an error occurred
+bool grug_enable_jit_mod_images(void) __attribute__((warn_unused_result));
+
+// Makes grug_regenerate_modified_mods() only add grug files to the entity index,
+// and compile and load a grug file once grug_get_entity_file() is called for its entity the first time
+// So startup time and memory usage depend on the entities that the game uses, rather than on the installed mods
+// The entities that a loaded grug file depends on are still checked, since unloaded entities have a known entity type
+// Only loaded grug files are recompiled when they're modified, and show up in grug_reloads
+// This can't be used together with grug_enable_background_regeneration()
+// This has to be called before the first grug_regenerate_modified_mods() call
+void grug_enable_lazy_loading(void);
+
+// Makes grug_regenerate_modified_mods() generate faster machine code for the on_ and helper fns
+// Binary expressions keep their right operand in a register, instead of pushing it onto the stack
+// Constant i32, f32 and bool expressions are evaluated during compilation, so an overflow or division by 0 in one is a compilation error
+// Global variables that have a constant initial value and are never reassigned are replaced by that value
+// Pairs of adjacent instructions that can be done with fewer, like a `push rax` directly followed by a `pop rdi`, are combined
+// The conditions of if and while statements jump straight on the result of their comparisons, instead of first storing it in a bool
+// The global variables pointer is kept in the rbx register, instead of being loaded from the stack on every global variable access
+// The dlls are named like "labrador-Dog.optimized.so", so the dlls that were generated without this are never reused
+// This has to be called before the first grug_regenerate_modified_mods() call
+void grug_enable_optimizations(void);
+
 // Do NOT store the returned pointer, as it has a chance to dangle
 // after the next grug_regenerate_modified_mods() call!
+// Returns NULL if the entity doesn't exist
+// With grug_enable_lazy_loading(), this can compile and load the grug file of the entity,
+// in which case an error also returns NULL, and fills grug_error
+// With grug_enable_background_regeneration(), the returned pointer stays valid until the calling thread
+// calls grug_report_quiescent_state(), rather than until the next grug_regenerate_modified_mods() call
 struct grug_file *grug_get_entity_file(const char *entity) __attribute__((warn_unused_result));
 
+// Returns the about.json fields of the mod, like its "version", or NULL if the mod isn't loaded
+// The about.json file of a mod is only parsed again once it has been modified
+// Do NOT store the returned pointer, as it has a chance to dangle
+// after the next grug_regenerate_modified_mods() call!
+const struct grug_mod_about *grug_get_mod_about(const char *mod_name) __attribute__((warn_unused_result));
+
 // Calling this during a game function will cause grug
 // to immediately return a runtime error, from the current on_ function call
 void grug_game_function_error_happened(const char *message);
@@ -62,11 +188,6 @@ void grug_set_on_fns_to_fast_mode(void);
 bool grug_are_on_fns_in_safe_mode(void) __attribute__((warn_unused_result));
 void grug_toggle_on_fns_mode(void);
 
-//// Defines
-
-#define MAX_RELOADS 6969
-#define MAX_RESOURCE_RELOADS 6969
-
 //// Structs
 
 struct grug_file {
@@ -81,34 +202,87 @@ struct grug_file {
 
 	void *on_fns;
 
-	int64_t *_resource_mtimes;
+	// Indices into grug's index of the resources that the loaded grug files reference
+	uint32_t *_resources;
 	size_t _resources_size;
 
+	// Indices into grug's table of the entities that this grug file depends on,
+	// and the entity type that mod_api.json expects of each, where "" means any entity type
+	uint32_t *_entity_dependencies;
+	const char **_entity_dependency_types;
+	size_t _entity_dependencies_size;
+
+	// Only filled in by grug_enable_lazy_loading(), which needs it to load the grug file later
+	const char *_grug_path;
+
+	// -1, unless the dll was opened from a memfd
+	int _dll_fd;
+
+	// A hash of the bytes of the loaded dll, or 0 if none was generated since grug_init()
+	// A recompiled grug file whose dll has the same hash isn't reloaded, like after only a comment was edited
+	uint64_t _dll_hash;
+
+	// The grug file its mtime when its dll was last regenerated
+	int64_t _grug_mtime;
+
 	bool _seen;
 };
 
+struct grug_mod_about_field {
+	const char *key;
+
+	// NULL if the value isn't a string, but an array or object
+	const char *value;
+};
+
+struct grug_mod_about {
+	const char *name;
+	const char *version;
+	const char *game_version;
+	const char *author;
+
+	// The fields that come after "author", in the order of the about.json file
+	struct grug_mod_about_field *extra_fields;
+	size_t extra_fields_size;
+};
+
 struct grug_mod_dir {
 	const char *name;
 
 	struct grug_mod_dir *dirs;
 	size_t dirs_size;
 	size_t _dirs_capacity;
+	uint32_t *_dirs_buckets;
+	uint32_t *_dirs_chains;
 
 	struct grug_file *files;
 	size_t files_size;
 	size_t _files_capacity;
+	uint32_t *_files_buckets;
+	uint32_t *_files_chains;
+
+	// Only filled in for the directories directly inside of the mods directory
+	struct grug_mod_about about;
+
+	// The about.json file its mtime and size when it was last parsed
+	int64_t _about_mtime_ns;
+	int64_t _about_size;
+
+	// The directory its mtime when its entries were last read, or 0 if they have to be read again
+	// A directory its mtime only changes when entries are added, removed or renamed, so an unchanged directory isn't read again
+	int64_t _mtime_ns;
 
 	bool _seen;
 };
 
 struct grug_modified {
-	char path[4096];
+	const char *path;
 	void *old_dll;
 	struct grug_file file;
 };
 
 struct grug_modified_resource {
-	char path[4096];
+	const char *path;
 };
 
 struct grug_error {
@@ -122,10 +296,13 @@ struct grug_error {
 
 extern struct grug_mod_dir grug_mods;
 
-extern struct grug_modified grug_reloads[MAX_RELOADS];
+// These are only valid until the next regenerate call,
+// so copy the paths that need to be kept around for longer
+// Grug files that were recompiled into the exact same dll, like after only a comment was edited, aren't reloaded
+extern struct grug_modified *grug_reloads;
 extern size_t grug_reloads_size;
 
-extern struct grug_modified_resource grug_resource_reloads[MAX_RESOURCE_RELOADS];
+extern struct grug_modified_resource *grug_resource_reloads;
 extern size_t grug_resource_reloads_size;
 
 extern struct grug_error grug_error;
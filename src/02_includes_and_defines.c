@@ -1,6 +1,7 @@
 //// INCLUDES AND DEFINES
 
 #define _XOPEN_SOURCE 700 // This is just so VS Code can find CLOCK_PROCESS_CPUTIME_ID
+#define _GNU_SOURCE // For memfd_create()
 
 #include "grug.h"
 
@@ -10,13 +11,18 @@
 #include <dlfcn.h>
 #include <elf.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <limits.h>
 #include <math.h>
 #include <setjmp.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <threads.h>
 #include <time.h>
@@ -30,22 +36,25 @@
 #define STUPID_MAX_PATH 4096
 
 static bool streq(const char *a, const char *b);
+static void check_if_grug_error_has_changed(void);
+static void *get_jit_dll_symbol(void *dll, const char *symbol_name);
 
+// These are defined in the hot reloading section, but the JIT needs their addresses
+extern bool grug_has_runtime_error_happened;
+extern bool grug_on_fns_in_safe_mode;
+
+// Compilation worker threads point grug_error_ptr at their own grug_error,
+// and leave checking whether it has changed to the thread that reports it
 #define grug_error(...) {\
-	if (snprintf(grug_error.msg, sizeof(grug_error.msg), __VA_ARGS__) < 0) {\
+	if (snprintf(grug_error_ptr->msg, sizeof(grug_error_ptr->msg), __VA_ARGS__) < 0) {\
 		abort();\
 	}\
 	\
-	grug_error.grug_c_line_number = __LINE__;\
-	\
-	grug_error.has_changed =\
-		!streq(grug_error.msg, previous_grug_error.msg)\
-	 || !streq(grug_error.path, previous_grug_error.path)\
-	 || grug_error.grug_c_line_number != previous_grug_error.grug_c_line_number;\
+	grug_error_ptr->grug_c_line_number = __LINE__;\
 	\
-	memcpy(previous_grug_error.msg, grug_error.msg, sizeof(grug_error.msg));\
-	memcpy(previous_grug_error.path, grug_error.path, sizeof(grug_error.path));\
-	previous_grug_error.grug_c_line_number = grug_error.grug_c_line_number;\
+	if (grug_error_ptr == &grug_error) {\
+		check_if_grug_error_has_changed();\
+	}\
 	\
 	longjmp(error_jmp_buffer, 1);\
 }
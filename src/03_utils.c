@@ -13,8 +13,10 @@ typedef float f32;
 USED_BY_PROGRAMS struct grug_error grug_error;
 USED_BY_PROGRAMS bool grug_loading_error_in_grug_file;
 
+static thread_local struct grug_error *grug_error_ptr = &grug_error;
+
 static struct grug_error previous_grug_error;
-static jmp_buf error_jmp_buffer;
+static thread_local jmp_buf error_jmp_buffer;
 
 static char mods_root_dir_path[STUPID_MAX_PATH];
 static char dll_root_dir_path[STUPID_MAX_PATH];
@@ -23,6 +25,17 @@ static bool streq(const char *a, const char *b) {
 	return strcmp(a, b) == 0;
 }
 
+static void check_if_grug_error_has_changed(void) {
+	grug_error.has_changed =
+		!streq(grug_error.msg, previous_grug_error.msg)
+	 || !streq(grug_error.path, previous_grug_error.path)
+	 || grug_error.grug_c_line_number != previous_grug_error.grug_c_line_number;
+
+	memcpy(previous_grug_error.msg, grug_error.msg, sizeof(grug_error.msg));
+	memcpy(previous_grug_error.path, grug_error.path, sizeof(grug_error.path));
+	previous_grug_error.grug_c_line_number = grug_error.grug_c_line_number;
+}
+
 static bool starts_with(const char *haystack, const char *needle) {
 	return strncmp(haystack, needle, strlen(needle)) == 0;
 }
@@ -68,6 +81,19 @@ static unsigned long bfd_hash(const char *string) {
 	return hash;
 }
 
+#define FNV_1A_OFFSET_BASIS 0xcbf29ce484222325
+#define FNV_1A_PRIME 0x100000001b3
+
+// The initial hash should be FNV_1A_OFFSET_BASIS, and the returned hash can be passed back in to hash more data
+// From https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function#FNV-1a_hash
+static u64 fnv_1a_hash(u64 hash, const void *data, size_t size) {
+	for (const u8 *byte = data; size > 0; byte++, size--) {
+		hash ^= *byte;
+		hash *= FNV_1A_PRIME;
+	}
+	return hash;
+}
+
 static const char *get_file_extension(const char *filename) {
 	const char *ext = strrchr(filename, '.');
 	if (ext) {
@@ -82,6 +108,12 @@ static void print_dlerror(const char *function_name) {
 	grug_error("%s: %s", function_name, err);
 }
 
+// See grug_enable_jit()
+static bool are_dlls_jitted = false;
+
 static void *get_dll_symbol(void *dll, const char *symbol_name) {
+	if (are_dlls_jitted) {
+		return get_jit_dll_symbol(dll, symbol_name);
+	}
 	return dlsym(dll, symbol_name);
 }
@@ -4,7 +4,8 @@
 
 #define MAX_CHARACTERS 420420
 
-static char grug_text[MAX_CHARACTERS];
+static char grug_text_storage[MAX_CHARACTERS];
+static thread_local char *grug_text = grug_text_storage;
 
 static void read_file(const char *path) {
 	FILE *f = fopen(path, "rb");
@@ -89,11 +89,13 @@ static const char *get_token_type_str[] = {
 	[F32_TOKEN] = "F32_TOKEN",
 	[COMMENT_TOKEN] = "COMMENT_TOKEN",
 };
-static struct token tokens[MAX_TOKENS];
-static size_t tokens_size;
+static struct token tokens_storage[MAX_TOKENS];
+static thread_local struct token *tokens = tokens_storage;
+static thread_local size_t tokens_size;
 
-static char token_strings[MAX_TOKEN_STRINGS_CHARACTERS];
-static size_t token_strings_size;
+static char token_strings_storage[MAX_TOKEN_STRINGS_CHARACTERS];
+static thread_local char *token_strings = token_strings_storage;
+static thread_local size_t token_strings_size;
 
 static void reset_tokenization(void) {
 	tokens_size = 0;
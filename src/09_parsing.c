@@ -87,8 +87,9 @@ static const char *get_expr_type_str[] = {
 	[CALL_EXPR] = "CALL_EXPR",
 	[PARENTHESIZED_EXPR] = "PARENTHESIZED_EXPR",
 };
-static struct expr exprs[MAX_EXPRS];
-static size_t exprs_size;
+static struct expr exprs_storage[MAX_EXPRS];
+static thread_local struct expr *exprs = exprs_storage;
+static thread_local size_t exprs_size;
 
 struct variable_statement {
 	const char *name;
@@ -154,8 +155,9 @@ static const char *get_statement_type_str[] = {
 	[EMPTY_LINE_STATEMENT] = "EMPTY_LINE_STATEMENT",
 	[COMMENT_STATEMENT] = "COMMENT_STATEMENT",
 };
-static struct statement statements[MAX_STATEMENTS];
-static size_t statements_size;
+static struct statement statements_storage[MAX_STATEMENTS];
+static thread_local struct statement *statements = statements_storage;
+static thread_local size_t statements_size;
 
 enum global_statement_type {
 	GLOBAL_VARIABLE,
@@ -180,11 +182,13 @@ static const char *get_global_statement_type_str[] = {
 	[GLOBAL_EMPTY_LINE] = "GLOBAL_EMPTY_LINE",
 	[GLOBAL_COMMENT] = "GLOBAL_COMMENT",
 };
-static struct global_statement global_statements[MAX_GLOBAL_STATEMENTS];
-static size_t global_statements_size;
+static struct global_statement global_statements_storage[MAX_GLOBAL_STATEMENTS];
+static thread_local struct global_statement *global_statements = global_statements_storage;
+static thread_local size_t global_statements_size;
 
-static struct argument arguments[MAX_ARGUMENTS];
-static size_t arguments_size;
+static struct argument arguments_storage[MAX_ARGUMENTS];
+static thread_local struct argument *arguments = arguments_storage;
+static thread_local size_t arguments_size;
 
 struct on_fn {
 	const char *fn_name;
@@ -195,8 +199,9 @@ struct on_fn {
 	bool calls_helper_fn;
 	bool contains_while_loop;
 };
-static struct on_fn on_fns[MAX_ON_FNS];
-static size_t on_fns_size;
+static struct on_fn on_fns_storage[MAX_ON_FNS];
+static thread_local struct on_fn *on_fns = on_fns_storage;
+static thread_local size_t on_fns_size;
 
 struct helper_fn {
 	const char *fn_name;
@@ -207,10 +212,13 @@ struct helper_fn {
 	struct statement *body_statements;
 	size_t body_statement_count;
 };
-static struct helper_fn helper_fns[MAX_HELPER_FNS];
-static size_t helper_fns_size;
-static u32 buckets_helper_fns[MAX_HELPER_FNS];
-static u32 chains_helper_fns[MAX_HELPER_FNS];
+static struct helper_fn helper_fns_storage[MAX_HELPER_FNS];
+static thread_local struct helper_fn *helper_fns = helper_fns_storage;
+static thread_local size_t helper_fns_size;
+static u32 buckets_helper_fns_storage[MAX_HELPER_FNS];
+static thread_local u32 *buckets_helper_fns = buckets_helper_fns_storage;
+static u32 chains_helper_fns_storage[MAX_HELPER_FNS];
+static thread_local u32 *chains_helper_fns = chains_helper_fns_storage;
 
 struct global_variable_statement {
 	const char *name;
@@ -218,18 +226,22 @@ struct global_variable_statement {
 	const char *type_name;
 	struct expr assignment_expr;
 };
-static struct global_variable_statement global_variable_statements[MAX_GLOBAL_VARIABLES];
-static size_t global_variable_statements_size;
+static struct global_variable_statement global_variable_statements_storage[MAX_GLOBAL_VARIABLES];
+static thread_local struct global_variable_statement *global_variable_statements = global_variable_statements_storage;
+static thread_local size_t global_variable_statements_size;
 
-static size_t indentation;
+static thread_local size_t indentation;
 
-static const char *called_helper_fn_names[MAX_CALLED_HELPER_FN_NAMES];
-static size_t called_helper_fn_names_size;
+static const char *called_helper_fn_names_storage[MAX_CALLED_HELPER_FN_NAMES];
+static thread_local const char **called_helper_fn_names = called_helper_fn_names_storage;
+static thread_local size_t called_helper_fn_names_size;
 
-static u32 buckets_called_helper_fn_names[MAX_CALLED_HELPER_FN_NAMES];
-static u32 chains_called_helper_fn_names[MAX_CALLED_HELPER_FN_NAMES];
+static u32 buckets_called_helper_fn_names_storage[MAX_CALLED_HELPER_FN_NAMES];
+static thread_local u32 *buckets_called_helper_fn_names = buckets_called_helper_fn_names_storage;
+static u32 chains_called_helper_fn_names_storage[MAX_CALLED_HELPER_FN_NAMES];
+static thread_local u32 *chains_called_helper_fn_names = chains_called_helper_fn_names_storage;
 
-static size_t parsing_depth;
+static thread_local size_t parsing_depth;
 
 static void reset_parsing(void) {
 	exprs_size = 0;
@@ -240,7 +252,7 @@ static void reset_parsing(void) {
 	helper_fns_size = 0;
 	global_variable_statements_size = 0;
 	called_helper_fn_names_size = 0;
-	memset(buckets_called_helper_fn_names, 0xff, sizeof(buckets_called_helper_fn_names));
+	memset(buckets_called_helper_fn_names, 0xff, MAX_CALLED_HELPER_FN_NAMES * sizeof(u32));
 	parsing_depth = 0;
 }
 
@@ -16,51 +16,71 @@ struct variable {
 	const char *type_name;
 	size_t offset;
 };
-static struct variable variables[MAX_VARIABLES_PER_FUNCTION];
-static size_t variables_size;
-static u32 buckets_variables[MAX_VARIABLES_PER_FUNCTION];
-static u32 chains_variables[MAX_VARIABLES_PER_FUNCTION];
-
-static struct variable global_variables[MAX_GLOBAL_VARIABLES];
-static size_t global_variables_size;
-static size_t globals_bytes;
-static u32 buckets_global_variables[MAX_GLOBAL_VARIABLES];
-static u32 chains_global_variables[MAX_GLOBAL_VARIABLES];
-
-static size_t stack_frame_bytes;
-static size_t max_stack_frame_bytes;
-
-static enum type fn_return_type;
-static const char *fn_return_type_name;
-static const char *filled_fn_name;
-
-static struct grug_entity *grug_entity;
-
-static u32 buckets_entity_on_fns[MAX_ON_FNS];
-static u32 chains_entity_on_fns[MAX_ON_FNS];
-
-static const char *mod;
-static char file_entity_type[MAX_FILE_ENTITY_TYPE_LENGTH];
-
-static u32 entity_types[MAX_ENTITY_DEPENDENCIES];
-static size_t entity_types_size;
-
-static const char *data_strings[MAX_DATA_STRINGS];
-static size_t data_strings_size;
-
-static u32 buckets_data_strings[MAX_DATA_STRINGS];
-static u32 chains_data_strings[MAX_DATA_STRINGS];
-
-static bool *parsed_fn_calls_helper_fn_ptr;
-static bool *parsed_fn_contains_while_loop_ptr;
+static struct variable variables_storage[MAX_VARIABLES_PER_FUNCTION];
+static thread_local struct variable *variables = variables_storage;
+static thread_local size_t variables_size;
+static u32 buckets_variables_storage[MAX_VARIABLES_PER_FUNCTION];
+static thread_local u32 *buckets_variables = buckets_variables_storage;
+static u32 chains_variables_storage[MAX_VARIABLES_PER_FUNCTION];
+static thread_local u32 *chains_variables = chains_variables_storage;
+
+static struct variable global_variables_storage[MAX_GLOBAL_VARIABLES];
+static thread_local struct variable *global_variables = global_variables_storage;
+static thread_local size_t global_variables_size;
+static thread_local size_t globals_bytes;
+static u32 buckets_global_variables_storage[MAX_GLOBAL_VARIABLES];
+static thread_local u32 *buckets_global_variables = buckets_global_variables_storage;
+static u32 chains_global_variables_storage[MAX_GLOBAL_VARIABLES];
+static thread_local u32 *chains_global_variables = chains_global_variables_storage;
+
+static thread_local size_t stack_frame_bytes;
+static thread_local size_t max_stack_frame_bytes;
+
+static thread_local enum type fn_return_type;
+static thread_local const char *fn_return_type_name;
+static thread_local const char *filled_fn_name;
+
+static thread_local struct grug_entity *grug_entity;
+
+static u32 buckets_entity_on_fns_storage[MAX_ON_FNS];
+static thread_local u32 *buckets_entity_on_fns = buckets_entity_on_fns_storage;
+static u32 chains_entity_on_fns_storage[MAX_ON_FNS];
+static thread_local u32 *chains_entity_on_fns = chains_entity_on_fns_storage;
+
+static thread_local const char *mod;
+static char file_entity_type_storage[MAX_FILE_ENTITY_TYPE_LENGTH];
+static thread_local char *file_entity_type = file_entity_type_storage;
+
+static u32 entity_types_storage[MAX_ENTITY_DEPENDENCIES];
+static thread_local u32 *entity_types = entity_types_storage;
+static thread_local size_t entity_types_size;
+
+static const char *data_strings_storage[MAX_DATA_STRINGS];
+static thread_local const char **data_strings = data_strings_storage;
+static thread_local size_t data_strings_size;
+
+static u32 buckets_data_strings_storage[MAX_DATA_STRINGS];
+static thread_local u32 *buckets_data_strings = buckets_data_strings_storage;
+static u32 chains_data_strings_storage[MAX_DATA_STRINGS];
+static thread_local u32 *chains_data_strings = chains_data_strings_storage;
+
+static thread_local bool *parsed_fn_calls_helper_fn_ptr;
+static thread_local bool *parsed_fn_contains_while_loop_ptr;
+
+// See grug_enable_optimizations()
+static bool are_optimizations_enabled = false;
+
+static bool reassigned_global_variables_storage[MAX_GLOBAL_VARIABLES];
+static thread_local bool *reassigned_global_variables = reassigned_global_variables_storage;
+static thread_local bool is_folding_global_variables;
 
 static void reset_filling(void) {
 	global_variables_size = 0;
 	globals_bytes = 0;
-	memset(buckets_global_variables, 0xff, sizeof(buckets_global_variables));
+	memset(buckets_global_variables, 0xff, MAX_GLOBAL_VARIABLES * sizeof(u32));
 	entity_types_size = 0;
 	data_strings_size = 0;
-	memset(buckets_data_strings, 0xff, sizeof(buckets_data_strings));
+	memset(buckets_data_strings, 0xff, MAX_DATA_STRINGS * sizeof(u32));
 }
 
 static void push_data_string(const char *string) {
@@ -121,7 +141,7 @@ static void validate_entity_string(const char *string) {
 
 	const char *colon = strchr(string, ':');
 	if (colon) {
-		static char temp_mod_name[MAX_ENTITY_DEPENDENCY_NAME_LENGTH];
+		static thread_local char temp_mod_name[MAX_ENTITY_DEPENDENCY_NAME_LENGTH];
 
 		size_t len = colon - string;
 		grug_assert(len > 0, "Entity '%s' is missing a mod name", string);
@@ -620,7 +640,7 @@ static void fill_statements(struct statement *body_statements, size_t statement_
 
 static void add_argument_variables(struct argument *fn_arguments, size_t argument_count) {
 	variables_size = 0;
-	memset(buckets_variables, 0xff, sizeof(buckets_variables));
+	memset(buckets_variables, 0xff, MAX_VARIABLES_PER_FUNCTION * sizeof(u32));
 
 	stack_frame_bytes = GLOBAL_VARIABLES_POINTER_SIZE;
 	max_stack_frame_bytes = stack_frame_bytes;
@@ -822,3 +842,348 @@ static void fill_result_types(void) {
 	fill_on_fns();
 	fill_helper_fns();
 }
+
+static bool is_constant_expr(struct expr *expr) {
+	return expr->type == TRUE_EXPR || expr->type == FALSE_EXPR || expr->type == I32_EXPR || expr->type == F32_EXPR;
+}
+
+static void set_bool_expr(struct expr *expr, bool value) {
+	expr->type = value ? TRUE_EXPR : FALSE_EXPR;
+}
+
+static void set_i32_expr(struct expr *expr, i32 value) {
+	expr->type = I32_EXPR;
+	expr->literal.i32 = value;
+}
+
+static void set_f32_expr(struct expr *expr, f32 value) {
+	expr->type = F32_EXPR;
+	expr->literal.f32.value = value;
+
+	// Only grug_dump_file_to_json() uses this, and it never folds constants
+	expr->literal.f32.string = NULL;
+}
+
+// Returns the initial value of the global variable, or NULL if it isn't a constant
+// Outside of the global variables, this also returns NULL if any fn reassigns the global variable
+static struct expr *get_constant_global_variable_value(const char *name) {
+	struct variable *var = get_global_variable(name);
+	if (!var) {
+		return NULL;
+	}
+
+	size_t global_index = var - global_variables;
+
+	// The first global variable is the secret "me" one, which doesn't have a global variable statement
+	if (global_index == 0) {
+		return NULL;
+	}
+
+	if (!is_folding_global_variables && reassigned_global_variables[global_index]) {
+		return NULL;
+	}
+
+	struct global_variable_statement *global = &global_variable_statements[global_index - 1];
+	assert(streq(global->name, name));
+
+	if (!is_constant_expr(&global->assignment_expr)) {
+		return NULL;
+	}
+
+	return &global->assignment_expr;
+}
+
+static void fold_expr(struct expr *expr);
+
+static void fold_unary_expr(struct expr *expr) {
+	struct unary_expr unary_expr = expr->unary;
+
+	fold_expr(unary_expr.expr);
+
+	struct expr *operand = unary_expr.expr;
+	if (!is_constant_expr(operand)) {
+		return;
+	}
+
+	if (unary_expr.operator == NOT_TOKEN) {
+		set_bool_expr(expr, operand->type == FALSE_EXPR);
+	} else if (operand->type == I32_EXPR) {
+		i32 n = operand->literal.i32;
+		grug_assert(n != INT32_MIN, "i32 overflow in the constant expression -(%d)", n);
+		set_i32_expr(expr, -n);
+	} else {
+		set_f32_expr(expr, -operand->literal.f32.value);
+	}
+}
+
+static void fold_i32_binary_expr(struct expr *expr, i32 left, enum token_type operator, i32 right) {
+	const char *operator_str = get_binary_operator_from_token(get_token_type_str[operator]);
+
+	i32 result;
+	switch (operator) {
+		case PLUS_TOKEN:
+			grug_assert(!__builtin_add_overflow(left, right, &result), "i32 overflow in the constant expression %d %s %d", left, operator_str, right);
+			set_i32_expr(expr, result);
+			break;
+		case MINUS_TOKEN:
+			grug_assert(!__builtin_sub_overflow(left, right, &result), "i32 overflow in the constant expression %d %s %d", left, operator_str, right);
+			set_i32_expr(expr, result);
+			break;
+		case MULTIPLICATION_TOKEN:
+			grug_assert(!__builtin_mul_overflow(left, right, &result), "i32 overflow in the constant expression %d %s %d", left, operator_str, right);
+			set_i32_expr(expr, result);
+			break;
+		case DIVISION_TOKEN:
+		case REMAINDER_TOKEN:
+			grug_assert(right != 0, "Division of an i32 by 0 in the constant expression %d %s %d", left, operator_str, right);
+			grug_assert(left != INT32_MIN || right != -1, "i32 overflow in the constant expression %d %s %d", left, operator_str, right);
+			set_i32_expr(expr, operator == DIVISION_TOKEN ? left / right : left % right);
+			break;
+		case EQUALS_TOKEN:
+			set_bool_expr(expr, left == right);
+			break;
+		case NOT_EQUALS_TOKEN:
+			set_bool_expr(expr, left != right);
+			break;
+		case GREATER_OR_EQUAL_TOKEN:
+			set_bool_expr(expr, left >= right);
+			break;
+		case GREATER_TOKEN:
+			set_bool_expr(expr, left > right);
+			break;
+		case LESS_OR_EQUAL_TOKEN:
+			set_bool_expr(expr, left <= right);
+			break;
+		case LESS_TOKEN:
+			set_bool_expr(expr, left < right);
+			break;
+		default:
+			grug_unreachable();
+	}
+}
+
+static void fold_f32_binary_expr(struct expr *expr, f32 left, enum token_type operator, f32 right) {
+	// The comiss instruction that compares f32s at runtime treats NaN as being equal to, and less than, everything,
+	// and which NaN an arithmetic instruction returns depends on the order of its operands,
+	// so anything involving NaN is left to the runtime
+	if (isnan(left) || isnan(right)) {
+		return;
+	}
+
+	switch (operator) {
+		case PLUS_TOKEN:
+			set_f32_expr(expr, left + right);
+			break;
+		case MINUS_TOKEN:
+			set_f32_expr(expr, left - right);
+			break;
+		case MULTIPLICATION_TOKEN:
+			set_f32_expr(expr, left * right);
+			break;
+		case DIVISION_TOKEN:
+			set_f32_expr(expr, left / right);
+			break;
+		case EQUALS_TOKEN:
+			set_bool_expr(expr, left == right);
+			break;
+		case NOT_EQUALS_TOKEN:
+			set_bool_expr(expr, left != right);
+			break;
+		case GREATER_OR_EQUAL_TOKEN:
+			set_bool_expr(expr, left >= right);
+			break;
+		case GREATER_TOKEN:
+			set_bool_expr(expr, left > right);
+			break;
+		case LESS_OR_EQUAL_TOKEN:
+			set_bool_expr(expr, left <= right);
+			break;
+		case LESS_TOKEN:
+			set_bool_expr(expr, left < right);
+			break;
+		default:
+			grug_unreachable();
+	}
+}
+
+static void fold_binary_expr(struct expr *expr) {
+	struct binary_expr binary_expr = expr->binary;
+
+	fold_expr(binary_expr.left_expr);
+	fold_expr(binary_expr.right_expr);
+
+	struct expr *left = binary_expr.left_expr;
+	struct expr *right = binary_expr.right_expr;
+	if (!is_constant_expr(left) || !is_constant_expr(right)) {
+		return;
+	}
+
+	if (left->type == I32_EXPR) {
+		fold_i32_binary_expr(expr, left->literal.i32, binary_expr.operator, right->literal.i32);
+	} else if (left->type == F32_EXPR) {
+		fold_f32_binary_expr(expr, left->literal.f32.value, binary_expr.operator, right->literal.f32.value);
+	} else if (binary_expr.operator == EQUALS_TOKEN) {
+		set_bool_expr(expr, left->type == right->type);
+	} else if (binary_expr.operator == NOT_EQUALS_TOKEN) {
+		set_bool_expr(expr, left->type != right->type);
+	} else {
+		grug_unreachable();
+	}
+}
+
+static void fold_logical_expr(struct expr *expr) {
+	struct binary_expr logical_expr = expr->binary;
+
+	fold_expr(logical_expr.left_expr);
+	fold_expr(logical_expr.right_expr);
+
+	struct expr *left = logical_expr.left_expr;
+	struct expr *right = logical_expr.right_expr;
+	if (!is_constant_expr(left)) {
+		return;
+	}
+
+	// `true and x` and `false or x` are just `x`
+	// `false and x` and `true or x` are only folded when x is a constant,
+	// so the game functions and entities in x are still checked
+	bool is_short_circuited = (logical_expr.operator == AND_TOKEN) == (left->type == FALSE_EXPR);
+	if (!is_short_circuited) {
+		*expr = *right;
+	} else if (is_constant_expr(right)) {
+		*expr = *left;
+	}
+}
+
+static void fold_expr(struct expr *expr) {
+	switch (expr->type) {
+		case TRUE_EXPR:
+		case FALSE_EXPR:
+		case STRING_EXPR:
+		case RESOURCE_EXPR:
+		case ENTITY_EXPR:
+		case I32_EXPR:
+		case F32_EXPR:
+			break;
+		case IDENTIFIER_EXPR: {
+			struct expr *value = get_constant_global_variable_value(expr->literal.string);
+			if (value) {
+				*expr = *value;
+			}
+			break;
+		}
+		case UNARY_EXPR:
+			fold_unary_expr(expr);
+			break;
+		case BINARY_EXPR:
+			fold_binary_expr(expr);
+			break;
+		case LOGICAL_EXPR:
+			fold_logical_expr(expr);
+			break;
+		case CALL_EXPR:
+			for (size_t i = 0; i < expr->call.argument_count; i++) {
+				fold_expr(&expr->call.arguments[i]);
+			}
+			break;
+		case PARENTHESIZED_EXPR:
+			fold_expr(expr->parenthesized);
+			if (is_constant_expr(expr->parenthesized)) {
+				*expr = *expr->parenthesized;
+			}
+			break;
+	}
+}
+
+static void fold_statements(struct statement *body_statements, size_t statement_count) {
+	for (size_t i = 0; i < statement_count; i++) {
+		struct statement *statement = &body_statements[i];
+
+		switch (statement->type) {
+			case VARIABLE_STATEMENT:
+				fold_expr(statement->variable_statement.assignment_expr);
+				break;
+			case CALL_STATEMENT:
+				fold_expr(statement->call_statement.expr);
+				break;
+			case IF_STATEMENT:
+				fold_expr(&statement->if_statement.condition);
+				fold_statements(statement->if_statement.if_body_statements, statement->if_statement.if_body_statement_count);
+				fold_statements(statement->if_statement.else_body_statements, statement->if_statement.else_body_statement_count);
+				break;
+			case RETURN_STATEMENT:
+				if (statement->return_statement.has_value) {
+					fold_expr(statement->return_statement.value);
+				}
+				break;
+			case WHILE_STATEMENT:
+				fold_expr(&statement->while_statement.condition);
+				fold_statements(statement->while_statement.body_statements, statement->while_statement.body_statement_count);
+				break;
+			case BREAK_STATEMENT:
+			case CONTINUE_STATEMENT:
+			case EMPTY_LINE_STATEMENT:
+			case COMMENT_STATEMENT:
+				break;
+		}
+	}
+}
+
+static void mark_reassigned_global_variables(struct statement *body_statements, size_t statement_count) {
+	for (size_t i = 0; i < statement_count; i++) {
+		struct statement statement = body_statements[i];
+
+		switch (statement.type) {
+			case VARIABLE_STATEMENT:
+				// Local variables can't shadow global variables, so this is always an assignment to the global variable
+				if (!statement.variable_statement.has_type) {
+					struct variable *var = get_global_variable(statement.variable_statement.name);
+					if (var) {
+						reassigned_global_variables[var - global_variables] = true;
+					}
+				}
+				break;
+			case IF_STATEMENT:
+				mark_reassigned_global_variables(statement.if_statement.if_body_statements, statement.if_statement.if_body_statement_count);
+				mark_reassigned_global_variables(statement.if_statement.else_body_statements, statement.if_statement.else_body_statement_count);
+				break;
+			case WHILE_STATEMENT:
+				mark_reassigned_global_variables(statement.while_statement.body_statements, statement.while_statement.body_statement_count);
+				break;
+			case CALL_STATEMENT:
+			case RETURN_STATEMENT:
+			case BREAK_STATEMENT:
+			case CONTINUE_STATEMENT:
+			case EMPTY_LINE_STATEMENT:
+			case COMMENT_STATEMENT:
+				break;
+		}
+	}
+}
+
+// Evaluates the constant i32, f32 and bool expressions, so their overflows and divisions by 0 become compilation errors
+// Global variables that have a constant initial value and are never reassigned are replaced by that value
+static void fold_constants(void) {
+	// The global variables are initialized in order, so every earlier constant global variable is propagated,
+	// even if a fn reassigns it later
+	is_folding_global_variables = true;
+	for (size_t i = 0; i < global_variable_statements_size; i++) {
+		fold_expr(&global_variable_statements[i].assignment_expr);
+	}
+	is_folding_global_variables = false;
+
+	memset(reassigned_global_variables, false, global_variables_size * sizeof(bool));
+
+	for (size_t i = 0; i < on_fns_size; i++) {
+		mark_reassigned_global_variables(on_fns[i].body_statements, on_fns[i].body_statement_count);
+	}
+	for (size_t i = 0; i < helper_fns_size; i++) {
+		mark_reassigned_global_variables(helper_fns[i].body_statements, helper_fns[i].body_statement_count);
+	}
+
+	for (size_t i = 0; i < on_fns_size; i++) {
+		fold_statements(on_fns[i].body_statements, on_fns[i].body_statement_count);
+	}
+	for (size_t i = 0; i < helper_fns_size; i++) {
+		fold_statements(helper_fns[i].body_statements, helper_fns[i].body_statement_count);
+	}
+}
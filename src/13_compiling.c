@@ -94,12 +94,23 @@
 #define POP_R9 0x5941 // pop r9
 #define POP_R11 0x5b41 // pop r11
 
+#define MOV_TO_R11D 0xbb41 // mov r11d, n
+
 #define MOV_ESI_TO_DEREF_RBP_8_BIT_OFFSET 0x7589 // mov rbp[n], esi
 #define MOV_DEREF_RAX_TO_EAX_32_BIT_OFFSET 0x808b // mov eax, rax[n]
+#define JB_32_BIT_OFFSET 0x820f // jb strict $+n
+#define JAE_32_BIT_OFFSET 0x830f // jae strict $+n
 #define JE_32_BIT_OFFSET 0x840f // je strict $+n
+#define JNE_32_BIT_OFFSET 0x850f // jne strict $+n
+#define JBE_32_BIT_OFFSET 0x860f // jbe strict $+n
+#define JA_32_BIT_OFFSET 0x870f // ja strict $+n
 #define MOV_AL_TO_DEREF_RBP_32_BIT_OFFSET 0x8588 // mov rbp[n], al
 #define MOV_EAX_TO_DEREF_RBP_32_BIT_OFFSET 0x8589 // mov rbp[n], eax
+#define JL_32_BIT_OFFSET 0x8c0f // jl strict $+n
+#define JGE_32_BIT_OFFSET 0x8d0f // jge strict $+n
 #define MOV_ECX_TO_DEREF_RBP_32_BIT_OFFSET 0x8d89 // mov rbp[n], ecx
+#define JLE_32_BIT_OFFSET 0x8e0f // jle strict $+n
+#define JG_32_BIT_OFFSET 0x8f0f // jg strict $+n
 #define MOV_EDX_TO_DEREF_RBP_32_BIT_OFFSET 0x9589 // mov rbp[n], edx
 #define MOV_ESI_TO_DEREF_RBP_32_BIT_OFFSET 0xb589 // mov rbp[n], esi
 #define XOR_CLEAR_EAX 0xc031 // xor eax, eax
@@ -146,6 +157,9 @@
 #define MOV_R9_TO_DEREF_RBP_8_BIT_OFFSET 0x4d894c // mov rbp[n], r9
 #define MOV_RDX_TO_DEREF_RBP_8_BIT_OFFSET 0x558948 // mov rbp[n], rdx
 
+#define MOV_RBX_TO_DEREF_RBP_8_BIT_OFFSET 0x5d8948 // mov rbp[n], rbx
+#define MOV_DEREF_RBP_TO_R11D_8_BIT_OFFSET 0x5d8b44 // mov r11d, rbp[n]
+#define MOV_DEREF_RBP_TO_RBX_8_BIT_OFFSET 0x5d8b48 // mov rbx, rbp[n]
 #define MOV_DEREF_RBP_TO_R11_8_BIT_OFFSET 0x5d8b4c // mov r11, rbp[n]
 
 #define MOV_RSI_TO_DEREF_RBP_8_BIT_OFFSET 0x758948 // mov rbp[n], rsi
@@ -165,6 +179,8 @@
 #define MOV_RCX_TO_DEREF_RBP_32_BIT_OFFSET 0x8d8948 // mov rbp[n], rcx
 #define MOV_R9_TO_DEREF_RBP_32_BIT_OFFSET 0x8d894c // mov rbp[n], r9
 #define MOV_RDX_TO_DEREF_RBP_32_BIT_OFFSET 0x958948 // mov rbp[n], rdx
+#define MOV_DEREF_RBP_TO_R11D_32_BIT_OFFSET 0x9d8b44 // mov r11d, rbp[n]
+#define MOV_DEREF_RBP_TO_R11_32_BIT_OFFSET 0x9d8b4c // mov r11, rbp[n]
 #define MOV_RSI_TO_DEREF_RBP_32_BIT_OFFSET 0xb58948 // mov rbp[n], rsi
 
 #define SETB_AL 0xc0920f // setb al (set if below)
@@ -178,20 +194,35 @@
 #define SETLT_AL 0xc09c0f // setl al
 #define SETLE_AL 0xc09e0f // setle al
 
+#define MOVZX_AL_TO_EAX 0xc0b60f // movzx eax, al
+
 // See this for an explanation of "ordered" vs. "unordered":
 // https://stackoverflow.com/a/8627368/13279557
 #define ORDERED_CMP_XMM0_WITH_XMM1 0xc12f0f // comiss xmm0, xmm1
 
 #define ADD_RSP_32_BITS 0xc48148 // add rsp, n
 #define ADD_RSP_8_BITS 0xc48348 // add rsp, n
+#define MOV_RAX_TO_R8 0xc08949 // mov r8, rax
+#define MOV_RAX_TO_RCX 0xc18948 // mov rcx, rax
+#define MOV_RAX_TO_R9 0xc18949 // mov r9, rax
+#define MOV_RAX_TO_RDX 0xc28948 // mov rdx, rax
+#define MOV_RAX_TO_R10 0xc28949 // mov r10, rax
+#define MOV_RAX_TO_R11 0xc38949 // mov r11, rax
+#define MOV_R8_TO_R11 0xc3894d // mov r11, r8
+#define MOV_RAX_TO_RSI 0xc68948 // mov rsi, rax
 #define MOV_RAX_TO_RDI 0xc78948 // mov rdi, rax
+#define MOV_RCX_TO_R11 0xcb8949 // mov r11, rcx
+#define MOV_R9_TO_R11 0xcb894d // mov r11, r9
 #define MOV_RDX_TO_RAX 0xd08948 // mov rax, rdx
+#define MOV_R10_TO_R11 0xd3894d // mov r11, r10
 #define ADD_R11D_TO_EAX 0xd80144 // add eax, r11d
 #define SUB_R11D_FROM_EAX 0xd82944 // sub eax, r11d
 #define CMP_EAX_WITH_R11D 0xd83944 // cmp eax, r11d
 #define CMP_RAX_WITH_R11 0xd8394c // cmp rax, r11
+#define MOV_RBX_TO_RAX 0xd88948 // mov rax, rbx
 #define TEST_R11B_IS_ZERO 0xdb8445 // test r11b, r11b
 #define TEST_R11_IS_ZERO 0xdb854d // test r11, r11
+#define MOV_RBX_TO_R11 0xdb8949 // mov r11, rbx
 #define MOV_R11_TO_RSI 0xde894c // mov rsi, r11
 
 #define MOV_RSP_TO_RBP 0xe58948 // mov rbp, rsp
@@ -204,9 +235,13 @@
 #define MOV_RBP_TO_RSP 0xec8948 // mov rsp, rbp
 
 #define CMP_R11D_WITH_N 0xfb8141 // mov r11d, n
+#define MOV_RDI_TO_RBX 0xfb8948 // mov rbx, rdi
 
 #define DIV_RAX_BY_R11D 0xfbf741 // idiv r11d
 
+#define MOVZX_BYTE_DEREF_RBP_TO_R11D_8_BIT_OFFSET 0x5db60f44 // movzx r11d, byte rbp[n]
+#define MOVZX_BYTE_DEREF_RBP_TO_R11D_32_BIT_OFFSET 0x9db60f44 // movzx r11d, byte rbp[n]
+
 #define MOV_XMM0_TO_DEREF_RBP_8_BIT_OFFSET 0x45110ff3 // movss rbp[n], xmm0
 #define MOV_XMM1_TO_DEREF_RBP_8_BIT_OFFSET 0x4d110ff3 // movss rbp[n], xmm1
 #define MOV_XMM2_TO_DEREF_RBP_8_BIT_OFFSET 0x55110ff3 // movss rbp[n], xmm2
@@ -250,79 +285,113 @@ struct data_string_code {
 	size_t code_offset;
 };
 
-static size_t text_offsets[MAX_SYMBOLS];
+static size_t text_offsets_storage[MAX_SYMBOLS];
+static thread_local size_t *text_offsets = text_offsets_storage;
 
-static u8 codes[MAX_CODES];
-static size_t codes_size;
+static u8 codes_storage[MAX_CODES];
+static thread_local u8 *codes = codes_storage;
+static thread_local size_t codes_size;
 
-static char resource_strings[MAX_RESOURCE_STRINGS_CHARACTERS];
-static size_t resource_strings_size;
+// The offset of the last instruction emitted by compile_unpadded(), which peephole_optimize() may rewrite
+// This is SIZE_MAX when there is no such instruction, like when the code after it is a jump target
+static thread_local size_t peephole_offset;
 
-static char entity_dependency_strings[MAX_ENTITY_DEPENDENCIES_STRINGS_CHARACTERS];
-static size_t entity_dependency_strings_size;
+static char resource_strings_storage[MAX_RESOURCE_STRINGS_CHARACTERS];
+static thread_local char *resource_strings = resource_strings_storage;
+static thread_local size_t resource_strings_size;
 
-static struct data_string_code data_string_codes[MAX_DATA_STRING_CODES];
-static size_t data_string_codes_size;
+static char entity_dependency_strings_storage[MAX_ENTITY_DEPENDENCIES_STRINGS_CHARACTERS];
+static thread_local char *entity_dependency_strings = entity_dependency_strings_storage;
+static thread_local size_t entity_dependency_strings_size;
+
+static struct data_string_code data_string_codes_storage[MAX_DATA_STRING_CODES];
+static thread_local struct data_string_code *data_string_codes = data_string_codes_storage;
+static thread_local size_t data_string_codes_size;
 
 struct offset {
 	const char *name;
 	size_t offset;
 };
-static struct offset extern_fn_calls[MAX_GAME_FN_CALLS];
-static size_t extern_fn_calls_size;
-static struct offset helper_fn_calls[MAX_HELPER_FN_CALLS];
-static size_t helper_fn_calls_size;
+static struct offset extern_fn_calls_storage[MAX_GAME_FN_CALLS];
+static thread_local struct offset *extern_fn_calls = extern_fn_calls_storage;
+static thread_local size_t extern_fn_calls_size;
+static struct offset helper_fn_calls_storage[MAX_HELPER_FN_CALLS];
+static thread_local struct offset *helper_fn_calls = helper_fn_calls_storage;
+static thread_local size_t helper_fn_calls_size;
 
 struct used_extern_global_variable {
 	const char *variable_name;
 	size_t codes_offset;
 };
-static struct used_extern_global_variable used_extern_global_variables[MAX_USED_EXTERN_GLOBAL_VARIABLES];
-static size_t used_extern_global_variables_size;
-
-static const char *used_extern_fns[MAX_USED_GAME_FNS];
-static size_t extern_fns_size;
-static u32 buckets_used_extern_fns[BFD_HASH_BUCKET_SIZE];
-static u32 chains_used_extern_fns[MAX_USED_GAME_FNS];
-
-static char used_extern_fn_symbols[MAX_USED_EXTERN_FN_SYMBOLS_CHARACTERS];
-static size_t used_extern_fn_symbols_size;
-
-static struct offset helper_fn_offsets[MAX_HELPER_FN_OFFSETS];
-static size_t helper_fn_offsets_size;
-static u32 buckets_helper_fn_offsets[MAX_HELPER_FN_OFFSETS];
-static u32 chains_helper_fn_offsets[MAX_HELPER_FN_OFFSETS];
-
-static size_t pushed;
-
-static size_t start_of_loop_jump_offsets[MAX_LOOP_DEPTH];
+static struct used_extern_global_variable used_extern_global_variables_storage[MAX_USED_EXTERN_GLOBAL_VARIABLES];
+static thread_local struct used_extern_global_variable *used_extern_global_variables = used_extern_global_variables_storage;
+static thread_local size_t used_extern_global_variables_size;
+
+static const char *used_extern_fns_storage[MAX_USED_GAME_FNS];
+static thread_local const char **used_extern_fns = used_extern_fns_storage;
+static thread_local size_t extern_fns_size;
+static u32 buckets_used_extern_fns_storage[BFD_HASH_BUCKET_SIZE];
+static thread_local u32 *buckets_used_extern_fns = buckets_used_extern_fns_storage;
+static u32 chains_used_extern_fns_storage[MAX_USED_GAME_FNS];
+static thread_local u32 *chains_used_extern_fns = chains_used_extern_fns_storage;
+
+static char used_extern_fn_symbols_storage[MAX_USED_EXTERN_FN_SYMBOLS_CHARACTERS];
+static thread_local char *used_extern_fn_symbols = used_extern_fn_symbols_storage;
+static thread_local size_t used_extern_fn_symbols_size;
+
+static struct offset helper_fn_offsets_storage[MAX_HELPER_FN_OFFSETS];
+static thread_local struct offset *helper_fn_offsets = helper_fn_offsets_storage;
+static thread_local size_t helper_fn_offsets_size;
+static u32 buckets_helper_fn_offsets_storage[MAX_HELPER_FN_OFFSETS];
+static thread_local u32 *buckets_helper_fn_offsets = buckets_helper_fn_offsets_storage;
+static u32 chains_helper_fn_offsets_storage[MAX_HELPER_FN_OFFSETS];
+static thread_local u32 *chains_helper_fn_offsets = chains_helper_fn_offsets_storage;
+
+static thread_local size_t pushed;
+
+static size_t start_of_loop_jump_offsets_storage[MAX_LOOP_DEPTH];
+static thread_local size_t *start_of_loop_jump_offsets = start_of_loop_jump_offsets_storage;
 struct loop_break_statements {
 	size_t break_statements[MAX_BREAK_STATEMENTS_PER_LOOP];
 	size_t break_statements_size;
 };
-static struct loop_break_statements loop_break_statements_stack[MAX_LOOP_DEPTH];
-static size_t loop_depth;
+static struct loop_break_statements loop_break_statements_stack_storage[MAX_LOOP_DEPTH];
+static thread_local struct loop_break_statements *loop_break_statements_stack = loop_break_statements_stack_storage;
+static thread_local size_t loop_depth;
+
+static u32 resources_storage[MAX_RESOURCES];
+static thread_local u32 *resources = resources_storage;
+static thread_local size_t resources_size;
+
+static u32 entity_dependencies_storage[MAX_ENTITY_DEPENDENCIES];
+static thread_local u32 *entity_dependencies = entity_dependencies_storage;
+static thread_local size_t entity_dependencies_size;
 
-static u32 resources[MAX_RESOURCES];
-static size_t resources_size;
+static thread_local bool compiling_fast_mode;
 
-static u32 entity_dependencies[MAX_ENTITY_DEPENDENCIES];
-static size_t entity_dependencies_size;
+// Whether the function being compiled saved the caller's RBX in its stack frame, see compile_move_globals_ptr()
+static thread_local bool is_rbx_saved;
 
-static bool compiling_fast_mode;
+// The number of registers that compile_binary_expr() can keep right operands in,
+// while it compiles the left operand, instead of pushing them onto the stack
+// RDX isn't one of them, since CDQ and IDIV overwrite it
+#define SCRATCH_REGISTER_COUNT 4
+static thread_local size_t used_scratch_registers;
 
-static bool compiled_init_globals_fn;
+static thread_local bool compiled_init_globals_fn;
 
-static bool is_runtime_error_handler_used;
+static thread_local bool is_runtime_error_handler_used;
 
-static char helper_fn_mode_names[MAX_HELPER_FN_MODE_NAMES_CHARACTERS];
-static size_t helper_fn_mode_names_size;
+static char helper_fn_mode_names_storage[MAX_HELPER_FN_MODE_NAMES_CHARACTERS];
+static thread_local char *helper_fn_mode_names = helper_fn_mode_names_storage;
+static thread_local size_t helper_fn_mode_names_size;
 
-static const char *current_grug_path;
-static const char *current_fn_name;
+static thread_local const char *current_grug_path;
+static thread_local const char *current_fn_name;
 
 static void reset_compiling(void) {
 	codes_size = 0;
+	peephole_offset = SIZE_MAX;
 	resource_strings_size = 0;
 	entity_dependency_strings_size = 0;
 	data_string_codes_size = 0;
@@ -336,6 +405,8 @@ static void reset_compiling(void) {
 	resources_size = 0;
 	entity_dependencies_size = 0;
 	compiling_fast_mode = false;
+	is_rbx_saved = false;
+	used_scratch_registers = 0;
 	compiled_init_globals_fn = false;
 	is_runtime_error_handler_used = false;
 	helper_fn_mode_names_size = 0;
@@ -425,7 +496,7 @@ static bool has_used_extern_fn(const char *name) {
 }
 
 static void hash_used_extern_fns(void) {
-	memset(buckets_used_extern_fns, 0xff, sizeof(buckets_used_extern_fns));
+	memset(buckets_used_extern_fns, 0xff, BFD_HASH_BUCKET_SIZE * sizeof(u32));
 
 	for (size_t i = 0; i < extern_fn_calls_size; i++) {
 		const char *name = extern_fn_calls[i].name;
@@ -521,21 +592,127 @@ static void compile_32(u32 n) {
 	compile_padded(n, sizeof(u32));
 }
 
+static void compile_unpadded(u64 n);
+
+// Returns whether the last emitted instruction is exactly `size` bytes of `instruction`,
+// where any bytes after the opcode are expected to be 0, like the n in `mov eax, n`
+static bool is_last_instruction(u64 instruction, size_t size) {
+	if (peephole_offset == SIZE_MAX || peephole_offset + size != codes_size) {
+		return false;
+	}
+
+	for (size_t i = 0; i < size; i++) {
+		if (codes[peephole_offset + i] != (instruction & 0xff)) { // Little-endian
+			return false;
+		}
+		instruction >>= 8;
+	}
+
+	return true;
+}
+
+// Combines the last emitted instruction with the instruction n that is about to be emitted
+// Returns what should be emitted instead of n, where 0 means nothing
+// Only the last instruction is ever rewritten, and jump targets clear peephole_offset,
+// so the offsets in the relocation records and jumps that were already emitted stay correct
+static u64 peephole_optimize(u64 n) {
+	if (is_last_instruction(PUSH_RAX, 1)) {
+		u64 mov = 0;
+
+		switch (n) {
+			case POP_RAX:
+				codes_size = peephole_offset;
+				peephole_offset = SIZE_MAX;
+				return 0;
+			case POP_RCX:
+				mov = MOV_RAX_TO_RCX;
+				break;
+			case POP_RDX:
+				mov = MOV_RAX_TO_RDX;
+				break;
+			case POP_RSI:
+				mov = MOV_RAX_TO_RSI;
+				break;
+			case POP_RDI:
+				mov = MOV_RAX_TO_RDI;
+				break;
+			case POP_R8:
+				mov = MOV_RAX_TO_R8;
+				break;
+			case POP_R9:
+				mov = MOV_RAX_TO_R9;
+				break;
+			case POP_R11:
+				mov = MOV_RAX_TO_R11;
+				break;
+		}
+
+		if (mov) {
+			codes_size = peephole_offset;
+			return mov;
+		}
+	}
+
+	// `mov eax, 0` is used instead of `xor eax, eax` to keep the flags of a preceding `cmp`,
+	// but `setcc al` followed by `movzx eax, al` does the same without a partial register write
+	switch (n) {
+		case SETB_AL:
+		case SETAE_AL:
+		case SETE_AL:
+		case SETNE_AL:
+		case SETBE_AL:
+		case SETA_AL:
+		case SETGT_AL:
+		case SETGE_AL:
+		case SETLT_AL:
+		case SETLE_AL:
+			if (is_last_instruction(MOV_TO_EAX, 5)) {
+				codes_size = peephole_offset;
+				peephole_offset = SIZE_MAX;
+				compile_unpadded(n);
+				peephole_offset = codes_size;
+				return MOVZX_AL_TO_EAX;
+			}
+			break;
+	}
+
+	// EAX still holds the value that was just moved out of XMM0
+	if (n == MOV_EAX_TO_XMM0 && is_last_instruction(MOV_XMM0_TO_EAX, 4)) {
+		return 0;
+	}
+
+	peephole_offset = codes_size;
+	return n;
+}
+
 static void compile_unpadded(u64 n) {
+	if (are_optimizations_enabled && n != PLACEHOLDER_32) {
+		n = peephole_optimize(n);
+	}
+
 	while (n > 0) {
 		compile_byte(n & 0xff); // Little-endian
 		n >>= 8;
 	}
 }
 
+// The peephole optimizer may not move the start of the code that gets jumped to
+static void mark_jump_target(void) {
+	peephole_offset = SIZE_MAX;
+}
+
 static void overwrite_jmp_address_8(size_t jump_address, size_t size) {
 	assert(size > jump_address);
+	assert(size == codes_size);
+	mark_jump_target();
 	u8 n = size - (jump_address + 1);
 	codes[jump_address] = n;
 }
 
 static void overwrite_jmp_address_32(size_t jump_address, size_t size) {
 	assert(size > jump_address);
+	assert(size == codes_size);
+	mark_jump_target();
 	size_t byte_count = 4;
 	for (u32 n = size - (jump_address + byte_count); byte_count > 0; n >>= 8, byte_count--) {
 		codes[jump_address++] = n & 0xff; // Little-endian
@@ -551,7 +728,7 @@ static void stack_pop_r11(void) {
 }
 
 static void stack_push_rax(void) {
-	compile_byte(PUSH_RAX);
+	compile_unpadded(PUSH_RAX);
 	stack_frame_bytes += sizeof(u64);
 
 	pushed++;
@@ -705,7 +882,16 @@ static void compile_expr(struct expr expr);
 
 static void compile_statements(struct statement *statements_offset, size_t statement_count);
 
+static void compile_binary_expr_operands_into_registers(struct binary_expr binary_expr);
+
+static void add_resources_and_entity_dependencies(struct statement *statements_offset, size_t statement_count);
+
 static void compile_function_epilogue(void) {
+	if (is_rbx_saved) {
+		compile_unpadded(MOV_DEREF_RBP_TO_RBX_8_BIT_OFFSET);
+		compile_byte(-(u8)GLOBAL_VARIABLES_POINTER_SIZE);
+	}
+
 	compile_unpadded(MOV_RBP_TO_RSP);
 	compile_byte(POP_RBP);
 	compile_byte(RET);
@@ -912,19 +1098,172 @@ static void compile_save_fn_name_and_path(const char *grug_path, const char *fn_
 	compile_unpadded(MOV_R11_TO_DEREF_RAX);
 }
 
+// The end of a chain of condition jumps
+#define NO_CONDITION_JUMPS SIZE_MAX
+
+// All jumps of a condition that go to the same place are chained together through their placeholders,
+// where each placeholder holds the offset of the previous placeholder in the chain, until overwrite_condition_jumps()
+static size_t compile_condition_jump(u16 jump, size_t jumps) {
+	compile_unpadded(jump);
+	size_t offset = codes_size;
+	compile_32(jumps);
+	return offset;
+}
+
+static void overwrite_condition_jumps(size_t jumps) {
+	while (jumps != NO_CONDITION_JUMPS) {
+		u32 previous = codes[jumps] | codes[jumps + 1] << 8 | codes[jumps + 2] << 16 | (u32)codes[jumps + 3] << 24; // Little-endian
+
+		overwrite_jmp_address_32(jumps, codes_size);
+
+		jumps = previous == UINT32_MAX ? NO_CONDITION_JUMPS : previous;
+	}
+}
+
+// Returns the jump that is taken after a comparison when it is true, or when it is false
+// The f32 jumps check the same flags as the setcc instructions in compile_binary_expr()
+static u16 get_comparison_jump(struct binary_expr comparison, bool jump_if_true) {
+	bool is_f32 = comparison.left_expr->result_type == type_f32;
+
+	switch (comparison.operator) {
+		case EQUALS_TOKEN:
+			return jump_if_true ? JE_32_BIT_OFFSET : JNE_32_BIT_OFFSET;
+		case NOT_EQUALS_TOKEN:
+			return jump_if_true ? JNE_32_BIT_OFFSET : JE_32_BIT_OFFSET;
+		case GREATER_OR_EQUAL_TOKEN:
+			if (is_f32) {
+				return jump_if_true ? JAE_32_BIT_OFFSET : JB_32_BIT_OFFSET;
+			}
+			return jump_if_true ? JGE_32_BIT_OFFSET : JL_32_BIT_OFFSET;
+		case GREATER_TOKEN:
+			if (is_f32) {
+				return jump_if_true ? JA_32_BIT_OFFSET : JBE_32_BIT_OFFSET;
+			}
+			return jump_if_true ? JG_32_BIT_OFFSET : JLE_32_BIT_OFFSET;
+		case LESS_OR_EQUAL_TOKEN:
+			if (is_f32) {
+				return jump_if_true ? JBE_32_BIT_OFFSET : JA_32_BIT_OFFSET;
+			}
+			return jump_if_true ? JLE_32_BIT_OFFSET : JG_32_BIT_OFFSET;
+		case LESS_TOKEN:
+			if (is_f32) {
+				return jump_if_true ? JB_32_BIT_OFFSET : JAE_32_BIT_OFFSET;
+			}
+			return jump_if_true ? JL_32_BIT_OFFSET : JGE_32_BIT_OFFSET;
+		default:
+			grug_unreachable();
+	}
+}
+
+// Strings, resources and entities are compared with strcmp() instead
+static bool is_comparison(struct expr expr) {
+	if (expr.type != BINARY_EXPR) {
+		return false;
+	}
+
+	enum type type = expr.binary.left_expr->result_type;
+	if (type != type_bool && type != type_i32 && type != type_f32 && type != type_id) {
+		return false;
+	}
+
+	switch (expr.binary.operator) {
+		case EQUALS_TOKEN:
+		case NOT_EQUALS_TOKEN:
+		case GREATER_OR_EQUAL_TOKEN:
+		case GREATER_TOKEN:
+		case LESS_OR_EQUAL_TOKEN:
+		case LESS_TOKEN:
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Compiles a condition into jumps that are taken when it is `jump_if_true`, and fall through otherwise
+// With optimizations, comparisons jump straight on the flags of their `cmp` or `comiss`,
+// and `and` and `or` jump as soon as their left operand decides the result
+// Returns the new start of the `jumps` chain
+static size_t compile_condition_jumps(struct expr condition, bool jump_if_true, size_t jumps) {
+	if (are_optimizations_enabled) {
+		if (condition.type == PARENTHESIZED_EXPR) {
+			return compile_condition_jumps(*condition.parenthesized, jump_if_true, jumps);
+		}
+
+		if (condition.type == UNARY_EXPR && condition.unary.operator == NOT_TOKEN) {
+			return compile_condition_jumps(*condition.unary.expr, !jump_if_true, jumps);
+		}
+
+		if (condition.type == LOGICAL_EXPR) {
+			struct binary_expr logical_expr = condition.binary;
+
+			// `and` is decided by a false left operand, and `or` by a true one
+			bool left_decides = logical_expr.operator == OR_TOKEN;
+
+			if (left_decides == jump_if_true) {
+				jumps = compile_condition_jumps(*logical_expr.left_expr, jump_if_true, jumps);
+				return compile_condition_jumps(*logical_expr.right_expr, jump_if_true, jumps);
+			}
+
+			size_t skip_jumps = compile_condition_jumps(*logical_expr.left_expr, left_decides, NO_CONDITION_JUMPS);
+			jumps = compile_condition_jumps(*logical_expr.right_expr, jump_if_true, jumps);
+			overwrite_condition_jumps(skip_jumps);
+			return jumps;
+		}
+
+		if (is_comparison(condition)) {
+			struct binary_expr comparison = condition.binary;
+
+			compile_binary_expr_operands_into_registers(comparison);
+
+			switch (comparison.left_expr->result_type) {
+				case type_bool:
+				case type_i32:
+					compile_unpadded(CMP_EAX_WITH_R11D);
+					break;
+				case type_f32:
+					compile_unpadded(MOV_EAX_TO_XMM0);
+					compile_unpadded(MOV_R11D_TO_XMM1);
+					compile_unpadded(ORDERED_CMP_XMM0_WITH_XMM1);
+					break;
+				case type_id:
+					compile_unpadded(CMP_RAX_WITH_R11);
+					break;
+				case type_void:
+				case type_string:
+				case type_resource:
+				case type_entity:
+					grug_unreachable();
+			}
+
+			return compile_condition_jump(get_comparison_jump(comparison, jump_if_true), jumps);
+		}
+	}
+
+	compile_expr(condition);
+	compile_unpadded(TEST_AL_IS_ZERO);
+	return compile_condition_jump(jump_if_true ? JNE_32_BIT_OFFSET : JE_32_BIT_OFFSET, jumps);
+}
+
 static void compile_while_statement(struct while_statement while_statement) {
+	// fold_constants() can turn the condition into a bool literal
+	bool is_condition_constant = are_optimizations_enabled && (while_statement.condition.type == TRUE_EXPR || while_statement.condition.type == FALSE_EXPR);
+	if (is_condition_constant && while_statement.condition.type == FALSE_EXPR) {
+		add_resources_and_entity_dependencies(while_statement.body_statements, while_statement.body_statement_count);
+		return;
+	}
+
 	size_t start_of_loop_jump_offset = codes_size;
+	mark_jump_target();
 
 	grug_assert(loop_depth < MAX_LOOP_DEPTH, "There are more than %d while loops nested inside each other, exceeding MAX_LOOP_DEPTH", MAX_LOOP_DEPTH);
 	start_of_loop_jump_offsets[loop_depth] = start_of_loop_jump_offset;
 	loop_break_statements_stack[loop_depth].break_statements_size = 0;
 	loop_depth++;
 
-	compile_expr(while_statement.condition);
-	compile_unpadded(TEST_AL_IS_ZERO);
-	compile_unpadded(JE_32_BIT_OFFSET);
-	size_t end_jump_offset = codes_size;
-	compile_unpadded(PLACEHOLDER_32);
+	size_t end_jumps = NO_CONDITION_JUMPS;
+	if (!is_condition_constant) {
+		end_jumps = compile_condition_jumps(while_statement.condition, false, NO_CONDITION_JUMPS);
+	}
 
 	compile_statements(while_statement.body_statements, while_statement.body_statement_count);
 
@@ -935,7 +1274,7 @@ static void compile_while_statement(struct while_statement while_statement) {
 	compile_unpadded(JMP_32_BIT_OFFSET);
 	compile_32(start_of_loop_jump_offset - (codes_size + NEXT_INSTRUCTION_OFFSET));
 
-	overwrite_jmp_address_32(end_jump_offset, codes_size);
+	overwrite_condition_jumps(end_jumps);
 
 	struct loop_break_statements *loop_break_statements = &loop_break_statements_stack[loop_depth - 1];
 
@@ -949,11 +1288,21 @@ static void compile_while_statement(struct while_statement while_statement) {
 }
 
 static void compile_if_statement(struct if_statement if_statement) {
-	compile_expr(if_statement.condition);
-	compile_unpadded(TEST_AL_IS_ZERO);
-	compile_unpadded(JE_32_BIT_OFFSET);
-	size_t else_or_end_jump_offset = codes_size;
-	compile_unpadded(PLACEHOLDER_32);
+	// fold_constants() can turn the condition into a bool literal, in which case only one of the bodies is compiled
+	if (are_optimizations_enabled && (if_statement.condition.type == TRUE_EXPR || if_statement.condition.type == FALSE_EXPR)) {
+		// The resources and entity dependencies of the body that isn't compiled are still added,
+		// since type propagation already added the entity types of its entities
+		if (if_statement.condition.type == TRUE_EXPR) {
+			compile_statements(if_statement.if_body_statements, if_statement.if_body_statement_count);
+			add_resources_and_entity_dependencies(if_statement.else_body_statements, if_statement.else_body_statement_count);
+		} else {
+			add_resources_and_entity_dependencies(if_statement.if_body_statements, if_statement.if_body_statement_count);
+			compile_statements(if_statement.else_body_statements, if_statement.else_body_statement_count);
+		}
+		return;
+	}
+
+	size_t else_or_end_jumps = compile_condition_jumps(if_statement.condition, false, NO_CONDITION_JUMPS);
 	compile_statements(if_statement.if_body_statements, if_statement.if_body_statement_count);
 
 	if (if_statement.else_body_statement_count > 0) {
@@ -961,13 +1310,13 @@ static void compile_if_statement(struct if_statement if_statement) {
 		size_t skip_else_jump_offset = codes_size;
 		compile_unpadded(PLACEHOLDER_32);
 
-		overwrite_jmp_address_32(else_or_end_jump_offset, codes_size);
+		overwrite_condition_jumps(else_or_end_jumps);
 
 		compile_statements(if_statement.else_body_statements, if_statement.else_body_statement_count);
 
 		overwrite_jmp_address_32(skip_else_jump_offset, codes_size);
 	} else {
-		overwrite_jmp_address_32(else_or_end_jump_offset, codes_size);
+		overwrite_condition_jumps(else_or_end_jumps);
 	}
 }
 
@@ -1086,15 +1435,20 @@ static void compile_call_expr(struct call_expr call_expr) {
 		}
 	}
 
+	size_t popped_argument_count = integer_argument_count + float_argument_count;
+
 	if (calls_helper_fn) {
-		// Push the secret global variables pointer argument
-		compile_unpadded(MOV_DEREF_RBP_TO_RAX_8_BIT_OFFSET);
-		compile_byte(-(u8)GLOBAL_VARIABLES_POINTER_SIZE);
-		stack_push_rax();
+		if (are_optimizations_enabled) {
+			// The helper fn already has the secret global variables pointer in RBX, so RDI is left unused
+			popped_argument_count--;
+		} else {
+			// Push the secret global variables pointer argument
+			compile_unpadded(MOV_DEREF_RBP_TO_RAX_8_BIT_OFFSET);
+			compile_byte(-(u8)GLOBAL_VARIABLES_POINTER_SIZE);
+			stack_push_rax();
+		}
 	}
 
-	size_t popped_argument_count = integer_argument_count + float_argument_count;
-
 	// The reason we need to decrement `pushed` and `stack_frame_bytes` here manually,
 	// rather than having pop_rax(), pop_rdi(), etc. do it for us,
 	// is because we use the lookup tables movs[] and pops[] below here
@@ -1110,7 +1464,9 @@ static void compile_call_expr(struct call_expr call_expr) {
 
 	if (calls_helper_fn) {
 		// Pop the secret global variables pointer argument
-		compile_byte(POP_RDI);
+		if (!are_optimizations_enabled) {
+			compile_unpadded(POP_RDI);
+		}
 		popped_integers_count++;
 	}
 
@@ -1119,7 +1475,7 @@ static void compile_call_expr(struct call_expr call_expr) {
 
 		if (argument.result_type == type_f32) {
 			if (popped_floats_count < float_argument_count) {
-				compile_byte(POP_RAX);
+				compile_unpadded(POP_RAX);
 
 				static u32 movs[] = {
 					MOV_EAX_TO_XMM0,
@@ -1184,7 +1540,8 @@ static void compile_call_expr(struct call_expr call_expr) {
 			compile_32(offset);
 		}
 
-		stack_frame_bytes += offset;
+		assert(stack_frame_bytes >= offset);
+		stack_frame_bytes -= offset;
 	}
 
 	assert(pushed >= pushes);
@@ -1229,6 +1586,10 @@ static void compile_logical_expr(struct binary_expr logical_expr) {
 			compile_unpadded(JMP_32_BIT_OFFSET);
 			size_t end_jump_offset = codes_size;
 			compile_unpadded(PLACEHOLDER_32);
+
+			// The je above jumps here
+			mark_jump_target();
+
 			compile_expr(*logical_expr.right_expr);
 			compile_unpadded(TEST_AL_IS_ZERO);
 			compile_unpadded(MOV_TO_EAX);
@@ -1242,14 +1603,200 @@ static void compile_logical_expr(struct binary_expr logical_expr) {
 	}
 }
 
+// Returns whether compiling the expression emits a CALL, which overwrites the scratch registers
+static bool does_expr_call_fn(struct expr expr) {
+	switch (expr.type) {
+		case TRUE_EXPR:
+		case FALSE_EXPR:
+		case STRING_EXPR:
+		case RESOURCE_EXPR:
+		case ENTITY_EXPR:
+		case IDENTIFIER_EXPR:
+		case I32_EXPR:
+		case F32_EXPR:
+			return false;
+		case UNARY_EXPR:
+			return does_expr_call_fn(*expr.unary.expr);
+		case BINARY_EXPR: {
+			struct binary_expr binary_expr = expr.binary;
+			enum type type = binary_expr.left_expr->result_type;
+
+			// Comparing strings calls strcmp()
+			if ((binary_expr.operator == EQUALS_TOKEN || binary_expr.operator == NOT_EQUALS_TOKEN)
+			 && type != type_bool && type != type_i32 && type != type_f32 && type != type_id) {
+				return true;
+			}
+
+			return does_expr_call_fn(*binary_expr.left_expr) || does_expr_call_fn(*binary_expr.right_expr);
+		}
+		case LOGICAL_EXPR:
+			return does_expr_call_fn(*expr.binary.left_expr) || does_expr_call_fn(*expr.binary.right_expr);
+		case CALL_EXPR:
+			return true;
+		case PARENTHESIZED_EXPR:
+			return does_expr_call_fn(*expr.parenthesized);
+	}
+	grug_unreachable();
+}
+
+// Constants and local variables can't have side effects, nor cause runtime errors,
+// so they can be loaded into R11 after the left operand has been compiled
+static bool is_expr_loadable_into_r11(struct expr expr) {
+	switch (expr.type) {
+		case TRUE_EXPR:
+		case FALSE_EXPR:
+		case I32_EXPR:
+		case F32_EXPR:
+			return true;
+		case IDENTIFIER_EXPR:
+			return get_local_variable(expr.literal.string) != NULL;
+		case STRING_EXPR:
+		case RESOURCE_EXPR:
+		case ENTITY_EXPR:
+		case UNARY_EXPR:
+		case BINARY_EXPR:
+		case LOGICAL_EXPR:
+		case CALL_EXPR:
+		case PARENTHESIZED_EXPR:
+			return false;
+	}
+	grug_unreachable();
+}
+
+static void compile_expr_into_r11(struct expr expr) {
+	switch (expr.type) {
+		case TRUE_EXPR:
+			compile_unpadded(MOV_TO_R11D);
+			compile_32(1);
+			break;
+		case FALSE_EXPR:
+			compile_unpadded(MOV_TO_R11D);
+			compile_32(0);
+			break;
+		case I32_EXPR:
+			compile_unpadded(MOV_TO_R11D);
+			compile_32(expr.literal.i32);
+			break;
+		case F32_EXPR: {
+			compile_unpadded(MOV_TO_R11D);
+			unsigned const char *bytes = (unsigned const char *)&expr.literal.f32.value;
+			for (size_t i = 0; i < sizeof(float); i++) {
+				compile_byte(*bytes); // Little-endian
+				bytes++;
+			}
+			break;
+		}
+		case IDENTIFIER_EXPR: {
+			struct variable *var = get_local_variable(expr.literal.string);
+			assert(var);
+
+			switch (var->type) {
+				case type_void:
+				case type_resource:
+				case type_entity:
+					grug_unreachable();
+				case type_bool:
+					if (var->offset <= 0x80) {
+						compile_unpadded(MOVZX_BYTE_DEREF_RBP_TO_R11D_8_BIT_OFFSET);
+					} else {
+						compile_unpadded(MOVZX_BYTE_DEREF_RBP_TO_R11D_32_BIT_OFFSET);
+					}
+					break;
+				case type_i32:
+				case type_f32:
+					if (var->offset <= 0x80) {
+						compile_unpadded(MOV_DEREF_RBP_TO_R11D_8_BIT_OFFSET);
+					} else {
+						compile_unpadded(MOV_DEREF_RBP_TO_R11D_32_BIT_OFFSET);
+					}
+					break;
+				case type_string:
+				case type_id:
+					if (var->offset <= 0x80) {
+						compile_unpadded(MOV_DEREF_RBP_TO_R11_8_BIT_OFFSET);
+					} else {
+						compile_unpadded(MOV_DEREF_RBP_TO_R11_32_BIT_OFFSET);
+					}
+					break;
+			}
+
+			if (var->offset <= 0x80) {
+				compile_byte(-var->offset);
+			} else {
+				compile_32(-var->offset);
+			}
+			break;
+		}
+		case STRING_EXPR:
+		case RESOURCE_EXPR:
+		case ENTITY_EXPR:
+		case UNARY_EXPR:
+		case BINARY_EXPR:
+		case LOGICAL_EXPR:
+		case CALL_EXPR:
+		case PARENTHESIZED_EXPR:
+			grug_unreachable();
+	}
+}
+
+// Leaves the left operand in RAX, and the right operand in R11,
+// while keeping the right operand in a scratch register, rather than on the stack
+static void compile_binary_expr_operands_into_registers(struct binary_expr binary_expr) {
+	struct expr right_expr = *binary_expr.right_expr;
+	while (right_expr.type == PARENTHESIZED_EXPR) {
+		right_expr = *right_expr.parenthesized;
+	}
+
+	if (is_expr_loadable_into_r11(right_expr)) {
+		compile_expr(*binary_expr.left_expr);
+		compile_expr_into_r11(right_expr);
+		return;
+	}
+
+	compile_expr(right_expr);
+
+	// Every scratch register is caller-saved, so the right operand is only spilled onto the stack
+	// when the left operand calls a function, or when every scratch register is in use
+	if (used_scratch_registers == SCRATCH_REGISTER_COUNT || does_expr_call_fn(*binary_expr.left_expr)) {
+		stack_push_rax();
+		compile_expr(*binary_expr.left_expr);
+		stack_pop_r11();
+		return;
+	}
+
+	size_t scratch_register = used_scratch_registers++;
+
+	compile_unpadded((u32[]){
+		MOV_RAX_TO_R8,
+		MOV_RAX_TO_R9,
+		MOV_RAX_TO_R10,
+		MOV_RAX_TO_RCX,
+	}[scratch_register]);
+
+	compile_expr(*binary_expr.left_expr);
+
+	compile_unpadded((u32[]){
+		MOV_R8_TO_R11,
+		MOV_R9_TO_R11,
+		MOV_R10_TO_R11,
+		MOV_RCX_TO_R11,
+	}[scratch_register]);
+
+	used_scratch_registers--;
+}
+
 static void compile_binary_expr(struct expr expr) {
 	assert(expr.type == BINARY_EXPR);
 	struct binary_expr binary_expr = expr.binary;
 
-	compile_expr(*binary_expr.right_expr);
-	stack_push_rax();
-	compile_expr(*binary_expr.left_expr);
-	stack_pop_r11();
+	if (are_optimizations_enabled) {
+		compile_binary_expr_operands_into_registers(binary_expr);
+	} else {
+		compile_expr(*binary_expr.right_expr);
+		stack_push_rax();
+		compile_expr(*binary_expr.left_expr);
+		stack_pop_r11();
+	}
 
 	switch (binary_expr.operator) {
 		case PLUS_TOKEN:
@@ -1345,6 +1892,9 @@ static void compile_binary_expr(struct expr expr) {
 				compile_unpadded(PLACEHOLDER_32);
 				compile_unpadded(TEST_EAX_IS_ZERO);
 				compile_unpadded(SETE_AL);
+
+				// Clears the rest of strcmp()'s return value, so comparing this bool with another one works
+				compile_unpadded(MOVZX_AL_TO_EAX);
 			}
 			break;
 		case NOT_EQUALS_TOKEN:
@@ -1372,6 +1922,9 @@ static void compile_binary_expr(struct expr expr) {
 				compile_unpadded(PLACEHOLDER_32);
 				compile_unpadded(TEST_EAX_IS_ZERO);
 				compile_unpadded(SETNE_AL);
+
+				// Clears the rest of strcmp()'s return value, so comparing this bool with another one works
+				compile_unpadded(MOVZX_AL_TO_EAX);
 			}
 			break;
 		case GREATER_OR_EQUAL_TOKEN:
@@ -1475,7 +2028,7 @@ static void push_resource(u32 string_index) {
 }
 
 static const char *push_entity_dependency_string(const char *string) {
-	static char entity[MAX_ENTITY_DEPENDENCY_NAME_LENGTH];
+	static thread_local char entity[MAX_ENTITY_DEPENDENCY_NAME_LENGTH];
 
 	if (strchr(string, ':')) {
 		grug_assert(strlen(string) + 1 <= sizeof(entity), "There are more than %d characters in the entity string '%s', exceeding MAX_ENTITY_DEPENDENCY_NAME_LENGTH", MAX_ENTITY_DEPENDENCY_NAME_LENGTH, string);
@@ -1500,7 +2053,7 @@ static const char *push_entity_dependency_string(const char *string) {
 }
 
 static const char *push_resource_string(const char *string) {
-	static char resource[STUPID_MAX_PATH];
+	static thread_local char resource[STUPID_MAX_PATH];
 	grug_assert(snprintf(resource, sizeof(resource), "%s/%s/%s", mods_root_dir_path, mod, string) >= 0, "Filling the variable 'resource' failed");
 
 	size_t length = strlen(resource);
@@ -1517,6 +2070,110 @@ static const char *push_resource_string(const char *string) {
 	return resource_str;
 }
 
+// Returns the resource string that the code should point to
+static const char *add_resource(const char *string) {
+	string = push_resource_string(string);
+
+	bool had_string = get_data_string_index(string) != UINT32_MAX;
+
+	add_data_string(string);
+
+	if (!had_string) {
+		push_resource(get_data_string_index(string));
+	}
+
+	return string;
+}
+
+// Returns the entity string that the code should point to
+static const char *add_entity_dependency(const char *string) {
+	string = push_entity_dependency_string(string);
+
+	// This check prevents the output entities array from containing duplicate entities
+	if (!compiling_fast_mode) {
+		add_data_string(string);
+
+		// We can't do the same thing we do with RESOURCE_EXPR,
+		// where we only call `push_entity_dependency()` when `!had_string`,
+		// because the same entity dependency strings
+		// can have with different "entity_type" values in mod_api.json
+		// (namely, game fn 1 might have "car", and game fn 2 the empty string "")
+		push_entity_dependency(get_data_string_index(string));
+	}
+
+	return string;
+}
+
+static void add_resources_and_entity_dependencies_of_expr(struct expr expr) {
+	switch (expr.type) {
+		case TRUE_EXPR:
+		case FALSE_EXPR:
+		case STRING_EXPR:
+		case IDENTIFIER_EXPR:
+		case I32_EXPR:
+		case F32_EXPR:
+			break;
+		case RESOURCE_EXPR:
+			add_resource(expr.literal.string);
+			break;
+		case ENTITY_EXPR:
+			add_entity_dependency(expr.literal.string);
+			break;
+		case UNARY_EXPR:
+			add_resources_and_entity_dependencies_of_expr(*expr.unary.expr);
+			break;
+		case BINARY_EXPR:
+		case LOGICAL_EXPR:
+			add_resources_and_entity_dependencies_of_expr(*expr.binary.left_expr);
+			add_resources_and_entity_dependencies_of_expr(*expr.binary.right_expr);
+			break;
+		case CALL_EXPR:
+			for (size_t i = 0; i < expr.call.argument_count; i++) {
+				add_resources_and_entity_dependencies_of_expr(expr.call.arguments[i]);
+			}
+			break;
+		case PARENTHESIZED_EXPR:
+			add_resources_and_entity_dependencies_of_expr(*expr.parenthesized);
+			break;
+	}
+}
+
+// Does what compile_statements() would do with the resources and entities in the statements, without compiling them
+// Used for the bodies that fold_constants() made unreachable
+static void add_resources_and_entity_dependencies(struct statement *body_statements, size_t statement_count) {
+	for (size_t i = 0; i < statement_count; i++) {
+		struct statement statement = body_statements[i];
+
+		switch (statement.type) {
+			case VARIABLE_STATEMENT:
+				add_resources_and_entity_dependencies_of_expr(*statement.variable_statement.assignment_expr);
+				break;
+			case CALL_STATEMENT:
+				add_resources_and_entity_dependencies_of_expr(*statement.call_statement.expr);
+				break;
+			case IF_STATEMENT:
+				add_resources_and_entity_dependencies_of_expr(statement.if_statement.condition);
+				add_resources_and_entity_dependencies(statement.if_statement.if_body_statements, statement.if_statement.if_body_statement_count);
+				add_resources_and_entity_dependencies(statement.if_statement.else_body_statements, statement.if_statement.else_body_statement_count);
+				break;
+			case RETURN_STATEMENT:
+				if (statement.return_statement.has_value) {
+					add_resources_and_entity_dependencies_of_expr(*statement.return_statement.value);
+				}
+				break;
+			case WHILE_STATEMENT:
+				add_resources_and_entity_dependencies_of_expr(statement.while_statement.condition);
+				add_resources_and_entity_dependencies(statement.while_statement.body_statements, statement.while_statement.body_statement_count);
+				break;
+			case BREAK_STATEMENT:
+			case CONTINUE_STATEMENT:
+			case EMPTY_LINE_STATEMENT:
+			case COMMENT_STATEMENT:
+				break;
+		}
+	}
+}
+
 static void compile_expr(struct expr expr) {
 	switch (expr.type) {
 		case TRUE_EXPR:
@@ -1540,17 +2197,7 @@ static void compile_expr(struct expr expr) {
 			break;
 		}
 		case RESOURCE_EXPR: {
-			const char *string = expr.literal.string;
-
-			string = push_resource_string(string);
-
-			bool had_string = get_data_string_index(string) != UINT32_MAX;
-
-			add_data_string(string);
-
-			if (!had_string) {
-				push_resource(get_data_string_index(string));
-			}
+			const char *string = add_resource(expr.literal.string);
 
 			compile_unpadded(LEA_STRINGS_TO_RAX);
 
@@ -1561,21 +2208,7 @@ static void compile_expr(struct expr expr) {
 			break;
 		}
 		case ENTITY_EXPR: {
-			const char *string = expr.literal.string;
-
-			string = push_entity_dependency_string(string);
-
-			// This check prevents the output entities array from containing duplicate entities
-			if (!compiling_fast_mode) {
-				add_data_string(string);
-
-				// We can't do the same thing we do with RESOURCE_EXPR,
-				// where we only call `push_entity_dependency()` when `!had_string`,
-				// because the same entity dependency strings
-				// can have with different "entity_type" values in mod_api.json
-				// (namely, game fn 1 might have "car", and game fn 2 the empty string "")
-				push_entity_dependency(get_data_string_index(string));
-			}
+			const char *string = add_entity_dependency(expr.literal.string);
 
 			compile_unpadded(LEA_STRINGS_TO_RAX);
 
@@ -1626,8 +2259,12 @@ static void compile_expr(struct expr expr) {
 				return;
 			}
 
-			compile_unpadded(MOV_DEREF_RBP_TO_RAX_8_BIT_OFFSET);
-			compile_byte(-(u8)GLOBAL_VARIABLES_POINTER_SIZE);
+			if (are_optimizations_enabled) {
+				compile_unpadded(MOV_RBX_TO_RAX);
+			} else {
+				compile_unpadded(MOV_DEREF_RBP_TO_RAX_8_BIT_OFFSET);
+				compile_byte(-(u8)GLOBAL_VARIABLES_POINTER_SIZE);
+			}
 
 			var = get_global_variable(expr.literal.string);
 			switch (var->type) {
@@ -1707,8 +2344,12 @@ static void compile_expr(struct expr expr) {
 }
 
 static void compile_global_variable_statement(const char *name) {
-	compile_unpadded(MOV_DEREF_RBP_TO_R11_8_BIT_OFFSET);
-	compile_byte(-(u8)GLOBAL_VARIABLES_POINTER_SIZE);
+	if (are_optimizations_enabled) {
+		compile_unpadded(MOV_RBX_TO_R11);
+	} else {
+		compile_unpadded(MOV_DEREF_RBP_TO_R11_8_BIT_OFFSET);
+		compile_byte(-(u8)GLOBAL_VARIABLES_POINTER_SIZE);
+	}
 
 	struct variable *var = get_global_variable(name);
 	switch (var->type) {
@@ -1909,6 +2550,18 @@ static size_t compile_safe_je(void) {
 }
 
 static void compile_move_globals_ptr(void) {
+	// With optimizations, the secret global variables pointer is kept in RBX,
+	// since functions have to preserve RBX, so it doesn't have to be loaded from the stack frame on every use
+	// The caller's RBX is saved in the stack frame slot that the pointer would otherwise go in,
+	// and helper fns don't call this, as they get RBX from the on_ fn that called them
+	if (are_optimizations_enabled) {
+		compile_unpadded(MOV_RBX_TO_DEREF_RBP_8_BIT_OFFSET);
+		compile_byte(-(u8)GLOBAL_VARIABLES_POINTER_SIZE);
+		compile_unpadded(MOV_RDI_TO_RBX);
+		is_rbx_saved = true;
+		return;
+	}
+
 	// We need to move the secret global variables pointer to this function's stack frame,
 	// because the RDI register will get clobbered when this function calls another function:
 	// https://stackoverflow.com/a/55387707/13279557
@@ -1925,6 +2578,8 @@ static size_t round_to_power_of_2(size_t n, size_t multiple) {
 }
 
 static void compile_function_prologue(void) {
+	mark_jump_target();
+	is_rbx_saved = false;
 	compile_byte(PUSH_RBP);
 
 	// Deliberately leaving this out, as we also don't include the 8 byte starting offset
@@ -2012,7 +2667,9 @@ static void compile_helper_fn_impl(struct argument *fn_arguments, size_t argumen
 
 	compile_function_prologue();
 
-	compile_move_globals_ptr();
+	if (!are_optimizations_enabled) {
+		compile_move_globals_ptr();
+	}
 
 	move_arguments(fn_arguments, argument_count);
 
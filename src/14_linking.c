@@ -25,117 +25,144 @@
 #define grug_log_section(section_name)
 #endif
 
-static size_t shindex_hash;
-static size_t shindex_dynsym;
-static size_t shindex_dynstr;
-static size_t shindex_rela_dyn;
-static size_t shindex_rela_plt;
-static size_t shindex_plt;
-static size_t shindex_text;
-static size_t shindex_eh_frame;
-static size_t shindex_dynamic;
-static size_t shindex_got;
-static size_t shindex_got_plt;
-static size_t shindex_data;
-static size_t shindex_symtab;
-static size_t shindex_strtab;
-static size_t shindex_shstrtab;
-
-static const char *symbols[MAX_SYMBOLS];
-static size_t symbols_size;
-
-static size_t on_fns_symbol_offset;
-
-static size_t data_symbols_size;
-static size_t extern_data_symbols_size;
-
-static size_t symbol_name_dynstr_offsets[MAX_SYMBOLS];
-static size_t symbol_name_strtab_offsets[MAX_SYMBOLS];
-
-static u32 buckets_on_fns[MAX_ON_FNS];
-static u32 chains_on_fns[MAX_ON_FNS];
-
-static const char *shuffled_symbols[MAX_SYMBOLS];
-static size_t shuffled_symbols_size;
-
-static size_t shuffled_symbol_index_to_symbol_index[MAX_SYMBOLS];
-static size_t symbol_index_to_shuffled_symbol_index[MAX_SYMBOLS];
-
-static size_t first_extern_data_symbol_index;
-static size_t first_used_extern_fn_symbol_index;
-
-static size_t data_offsets[MAX_SYMBOLS];
-static size_t data_string_offsets[MAX_SYMBOLS];
-
-static u8 bytes[MAX_BYTES];
-static size_t bytes_size;
-
-static size_t symtab_index_first_global;
-
-static size_t pltgot_value_offset;
-
-static size_t text_size;
-static size_t data_size;
-static size_t hash_offset;
-static size_t hash_size;
-static size_t dynsym_offset;
-static size_t dynsym_placeholders_offset;
-static size_t dynsym_size;
-static size_t dynstr_offset;
-static size_t dynstr_size;
-static size_t rela_dyn_offset;
-static size_t rela_dyn_size;
-static size_t rela_plt_offset;
-static size_t rela_plt_size;
-static size_t plt_offset;
-static size_t plt_size;
-static size_t text_offset;
-static size_t eh_frame_offset;
-static size_t dynamic_offset;
-static size_t dynamic_size;
-static size_t got_offset;
-static size_t got_size;
-static size_t got_plt_offset;
-static size_t got_plt_size;
-static size_t data_offset;
-static size_t segment_0_size;
-static size_t symtab_offset;
-static size_t symtab_size;
-static size_t strtab_offset;
-static size_t strtab_size;
-static size_t shstrtab_offset;
-static size_t shstrtab_size;
-static size_t section_headers_offset;
-
-static size_t hash_shstrtab_offset;
-static size_t dynsym_shstrtab_offset;
-static size_t dynstr_shstrtab_offset;
-static size_t rela_dyn_shstrtab_offset;
-static size_t rela_plt_shstrtab_offset;
-static size_t plt_shstrtab_offset;
-static size_t text_shstrtab_offset;
-static size_t eh_frame_shstrtab_offset;
-static size_t dynamic_shstrtab_offset;
-static size_t got_shstrtab_offset;
-static size_t got_plt_shstrtab_offset;
-static size_t data_shstrtab_offset;
-static size_t symtab_shstrtab_offset;
-static size_t strtab_shstrtab_offset;
-static size_t shstrtab_shstrtab_offset;
-
-static struct offset game_fn_offsets[MAX_GAME_FN_OFFSETS];
-static size_t game_fn_offsets_size;
-static u32 buckets_game_fn_offsets[MAX_GAME_FN_OFFSETS];
-static u32 chains_game_fn_offsets[MAX_GAME_FN_OFFSETS];
-
-static struct offset global_variable_offsets[MAX_GLOBAL_VARIABLE_OFFSETS];
-static size_t global_variable_offsets_size;
-static u32 buckets_global_variable_offsets[MAX_GLOBAL_VARIABLE_OFFSETS];
-static u32 chains_global_variable_offsets[MAX_GLOBAL_VARIABLE_OFFSETS];
-
-static size_t resources_offset;
-static size_t entities_offset;
-static size_t entity_types_offset;
+static thread_local size_t shindex_hash;
+static thread_local size_t shindex_dynsym;
+static thread_local size_t shindex_dynstr;
+static thread_local size_t shindex_rela_dyn;
+static thread_local size_t shindex_rela_plt;
+static thread_local size_t shindex_plt;
+static thread_local size_t shindex_text;
+static thread_local size_t shindex_eh_frame;
+static thread_local size_t shindex_dynamic;
+static thread_local size_t shindex_got;
+static thread_local size_t shindex_got_plt;
+static thread_local size_t shindex_data;
+static thread_local size_t shindex_symtab;
+static thread_local size_t shindex_strtab;
+static thread_local size_t shindex_shstrtab;
+
+static const char *symbols_storage[MAX_SYMBOLS];
+static thread_local const char **symbols = symbols_storage;
+static thread_local size_t symbols_size;
+
+static thread_local size_t on_fns_symbol_offset;
+
+static thread_local size_t data_symbols_size;
+static thread_local size_t extern_data_symbols_size;
+
+static size_t symbol_name_dynstr_offsets_storage[MAX_SYMBOLS];
+static thread_local size_t *symbol_name_dynstr_offsets = symbol_name_dynstr_offsets_storage;
+static size_t symbol_name_strtab_offsets_storage[MAX_SYMBOLS];
+static thread_local size_t *symbol_name_strtab_offsets = symbol_name_strtab_offsets_storage;
+
+static u32 buckets_on_fns_storage[MAX_ON_FNS];
+static thread_local u32 *buckets_on_fns = buckets_on_fns_storage;
+static u32 chains_on_fns_storage[MAX_ON_FNS];
+static thread_local u32 *chains_on_fns = chains_on_fns_storage;
+
+static const char *shuffled_symbols_storage[MAX_SYMBOLS];
+static thread_local const char **shuffled_symbols = shuffled_symbols_storage;
+static thread_local size_t shuffled_symbols_size;
+
+static u32 buckets_shuffled_symbols_storage[BFD_HASH_BUCKET_SIZE];
+static thread_local u32 *buckets_shuffled_symbols = buckets_shuffled_symbols_storage;
+static u32 chains_shuffled_symbols_storage[MAX_SYMBOLS + 1]; // +1, because [0] is STN_UNDEF
+static thread_local u32 *chains_shuffled_symbols = chains_shuffled_symbols_storage;
+
+static size_t shuffled_symbol_index_to_symbol_index_storage[MAX_SYMBOLS];
+static thread_local size_t *shuffled_symbol_index_to_symbol_index = shuffled_symbol_index_to_symbol_index_storage;
+static size_t symbol_index_to_shuffled_symbol_index_storage[MAX_SYMBOLS];
+static thread_local size_t *symbol_index_to_shuffled_symbol_index = symbol_index_to_shuffled_symbol_index_storage;
+
+static thread_local size_t first_extern_data_symbol_index;
+static thread_local size_t first_used_extern_fn_symbol_index;
+
+static size_t data_offsets_storage[MAX_SYMBOLS];
+static thread_local size_t *data_offsets = data_offsets_storage;
+static size_t data_string_offsets_storage[MAX_SYMBOLS];
+static thread_local size_t *data_string_offsets = data_string_offsets_storage;
+
+static u32 buckets_hash_storage[MAX_HASH_BUCKETS];
+static thread_local u32 *buckets_hash = buckets_hash_storage;
+static u32 chains_hash_storage[MAX_SYMBOLS + 1]; // +1, because [0] is STN_UNDEF
+static thread_local u32 *chains_hash = chains_hash_storage;
+
+static u8 bytes_storage[MAX_BYTES];
+static thread_local u8 *bytes = bytes_storage;
+static thread_local size_t bytes_size;
+
+static thread_local size_t symtab_index_first_global;
+
+static thread_local size_t pltgot_value_offset;
+
+static thread_local size_t text_size;
+static thread_local size_t data_size;
+static thread_local size_t hash_offset;
+static thread_local size_t hash_size;
+static thread_local size_t dynsym_offset;
+static thread_local size_t dynsym_placeholders_offset;
+static thread_local size_t dynsym_size;
+static thread_local size_t dynstr_offset;
+static thread_local size_t dynstr_size;
+static thread_local size_t rela_dyn_offset;
+static thread_local size_t rela_dyn_size;
+static thread_local size_t rela_plt_offset;
+static thread_local size_t rela_plt_size;
+static thread_local size_t plt_offset;
+static thread_local size_t plt_size;
+static thread_local size_t text_offset;
+static thread_local size_t eh_frame_offset;
+static thread_local size_t dynamic_offset;
+static thread_local size_t dynamic_size;
+static thread_local size_t got_offset;
+static thread_local size_t got_size;
+static thread_local size_t got_plt_offset;
+static thread_local size_t got_plt_size;
+static thread_local size_t data_offset;
+static thread_local size_t segment_0_size;
+static thread_local size_t symtab_offset;
+static thread_local size_t symtab_size;
+static thread_local size_t strtab_offset;
+static thread_local size_t strtab_size;
+static thread_local size_t shstrtab_offset;
+static thread_local size_t shstrtab_size;
+static thread_local size_t section_headers_offset;
+
+static thread_local size_t hash_shstrtab_offset;
+static thread_local size_t dynsym_shstrtab_offset;
+static thread_local size_t dynstr_shstrtab_offset;
+static thread_local size_t rela_dyn_shstrtab_offset;
+static thread_local size_t rela_plt_shstrtab_offset;
+static thread_local size_t plt_shstrtab_offset;
+static thread_local size_t text_shstrtab_offset;
+static thread_local size_t eh_frame_shstrtab_offset;
+static thread_local size_t dynamic_shstrtab_offset;
+static thread_local size_t got_shstrtab_offset;
+static thread_local size_t got_plt_shstrtab_offset;
+static thread_local size_t data_shstrtab_offset;
+static thread_local size_t symtab_shstrtab_offset;
+static thread_local size_t strtab_shstrtab_offset;
+static thread_local size_t shstrtab_shstrtab_offset;
+
+static struct offset game_fn_offsets_storage[MAX_GAME_FN_OFFSETS];
+static thread_local struct offset *game_fn_offsets = game_fn_offsets_storage;
+static thread_local size_t game_fn_offsets_size;
+static u32 buckets_game_fn_offsets_storage[MAX_GAME_FN_OFFSETS];
+static thread_local u32 *buckets_game_fn_offsets = buckets_game_fn_offsets_storage;
+static u32 chains_game_fn_offsets_storage[MAX_GAME_FN_OFFSETS];
+static thread_local u32 *chains_game_fn_offsets = chains_game_fn_offsets_storage;
+
+static struct offset global_variable_offsets_storage[MAX_GLOBAL_VARIABLE_OFFSETS];
+static thread_local struct offset *global_variable_offsets = global_variable_offsets_storage;
+static thread_local size_t global_variable_offsets_size;
+static u32 buckets_global_variable_offsets_storage[MAX_GLOBAL_VARIABLE_OFFSETS];
+static thread_local u32 *buckets_global_variable_offsets = buckets_global_variable_offsets_storage;
+static u32 chains_global_variable_offsets_storage[MAX_GLOBAL_VARIABLE_OFFSETS];
+static thread_local u32 *chains_global_variable_offsets = chains_global_variable_offsets_storage;
+
+static thread_local size_t resources_offset;
+static thread_local size_t entities_offset;
+static thread_local size_t entity_types_offset;
 
 static thread_local u64 grug_max_rsp;
 static thread_local struct timespec grug_current_time;
@@ -1231,29 +1258,26 @@ static void push_hash(void) {
 	u32 nchain = 1 + symbols_size; // `1 + `, because index 0 is always STN_UNDEF (the value 0)
 	push_32(nchain);
 
-	static u32 buckets[MAX_HASH_BUCKETS];
-	memset(buckets, 0, nbucket * sizeof(u32));
-
-	static u32 chains[MAX_SYMBOLS + 1]; // +1, because [0] is STN_UNDEF
+	memset(buckets_hash, 0, nbucket * sizeof(u32));
 
 	size_t chains_size = 0;
 
-	chains[chains_size++] = 0; // The first entry in the chain is always STN_UNDEF
+	chains_hash[chains_size++] = 0; // The first entry in the chain is always STN_UNDEF
 
 	for (size_t i = 0; i < symbols_size; i++) {
 		u32 bucket_index = elf_hash(shuffled_symbols[i]) % nbucket;
 
-		chains[chains_size] = buckets[bucket_index];
+		chains_hash[chains_size] = buckets_hash[bucket_index];
 
-		buckets[bucket_index] = chains_size++;
+		buckets_hash[bucket_index] = chains_size++;
 	}
 
 	for (size_t i = 0; i < nbucket; i++) {
-		push_32(buckets[i]);
+		push_32(buckets_hash[i]);
 	}
 
 	for (size_t i = 0; i < chains_size; i++) {
-		push_32(chains[i]);
+		push_32(chains_hash[i]);
 	}
 
 	hash_size = bytes_size - hash_offset;
@@ -1634,27 +1658,23 @@ static void push_shuffled_symbol(const char *shuffled_symbol) {
 // See my blog post: https://mynameistrez.github.io/2024/06/19/array-based-hash-table-in-c.html
 // See https://sourceware.org/git/?p=binutils-gdb.git;a=blob;f=bfd/hash.c#l618)
 static void generate_shuffled_symbols(void) {
-	static u32 buckets[BFD_HASH_BUCKET_SIZE];
-
-	memset(buckets, 0, sizeof(buckets));
-
-	static u32 chains[MAX_SYMBOLS + 1]; // +1, because [0] is STN_UNDEF
+	memset(buckets_shuffled_symbols, 0, BFD_HASH_BUCKET_SIZE * sizeof(u32));
 
 	size_t chains_size = 0;
 
-	chains[chains_size++] = 0; // The first entry in the chain is always STN_UNDEF
+	chains_shuffled_symbols[chains_size++] = 0; // The first entry in the chain is always STN_UNDEF
 
 	for (size_t i = 0; i < symbols_size; i++) {
 		u32 hash = bfd_hash(symbols[i]);
 		u32 bucket_index = hash % BFD_HASH_BUCKET_SIZE;
 
-		chains[chains_size] = buckets[bucket_index];
+		chains_shuffled_symbols[chains_size] = buckets_shuffled_symbols[bucket_index];
 
-		buckets[bucket_index] = chains_size++;
+		buckets_shuffled_symbols[bucket_index] = chains_size++;
 	}
 
 	for (size_t i = 0; i < BFD_HASH_BUCKET_SIZE; i++) {
-		u32 chain_index = buckets[i];
+		u32 chain_index = buckets_shuffled_symbols[i];
 		if (chain_index == 0) {
 			continue;
 		}
@@ -1667,7 +1687,7 @@ static void generate_shuffled_symbols(void) {
 
 			push_shuffled_symbol(symbol);
 
-			chain_index = chains[chain_index];
+			chain_index = chains_shuffled_symbols[chain_index];
 			if (chain_index == 0) {
 				break;
 			}
@@ -1716,6 +1736,51 @@ static void init_section_header_indices(void) {
 	shindex_shstrtab = shindex++;
 }
 
+// The dll is written to a temporary file that is renamed over dll_path,
+// so other processes that share the dll directory never dlopen() a partially written dll
+static void write_shared_object(const char *dll_path) {
+	char tmp_dll_path[STUPID_MAX_PATH];
+	grug_assert(snprintf(tmp_dll_path, sizeof(tmp_dll_path), "%s.%d.tmp", dll_path, getpid()) >= 0, "Filling the variable 'tmp_dll_path' failed");
+
+	FILE *f = fopen(tmp_dll_path, "w");
+	grug_assert(f, "fopen: %s", strerror(errno));
+
+	// The temporary file is removed on failure, so it isn't left behind in the dll directory
+	if (fwrite(bytes, sizeof(u8), bytes_size, f) == 0) {
+		fclose(f);
+		unlink(tmp_dll_path);
+		grug_error("fwrite error");
+	}
+
+	if (fclose(f)) {
+		int saved_errno = errno;
+		unlink(tmp_dll_path);
+		grug_error("fclose: %s", strerror(saved_errno));
+	}
+
+	if (rename(tmp_dll_path, dll_path)) {
+		int saved_errno = errno;
+		unlink(tmp_dll_path);
+		grug_error("rename: %s", strerror(saved_errno));
+	}
+}
+
+// Reads a dll that another process generated into `bytes`
+static void read_shared_object(const char *dll_path) {
+	FILE *f = fopen(dll_path, "rb");
+	grug_assert(f, "fopen: %s: %s", dll_path, strerror(errno));
+
+	bytes_size = fread(bytes, sizeof(u8), MAX_BYTES, f);
+
+	bool is_too_big = !feof(f);
+	bool has_error = ferror(f);
+
+	grug_assert(fclose(f) == 0, "fclose: %s", strerror(errno));
+
+	grug_assert(!has_error, "fread error: %s", dll_path);
+	grug_assert(!is_too_big, "The dll %s is bigger than MAX_BYTES", dll_path);
+}
+
 static void generate_shared_object(const char *dll_path) {
 	text_size = codes_size;
 
@@ -1805,8 +1870,612 @@ static void generate_shared_object(const char *dll_path) {
 
 	patch_bytes();
 
-	FILE *f = fopen(dll_path, "w");
-	grug_assert(f, "fopen: %s", strerror(errno));
-	grug_assert(fwrite(bytes, sizeof(u8), bytes_size, f) > 0, "fwrite error");
-	grug_assert(fclose(f) == 0, "fclose: %s", strerror(errno));
+	// The bytes are left for the caller when the dll only lives in memory
+	if (dll_path) {
+		write_shared_object(dll_path);
+	}
+}
+
+//// JIT
+
+#define MAX_JIT_SYMBOLS 8 // globals_size, on_fns, resources_size, resources, entities_size, entities, entity_types, init_globals
+
+// The size of both the code half and the data half of a mod image, see grug_enable_jit_mod_images()
+// Both halves are next to each other, so RIP-relative references from code to data are always within 2 GiB
+#define JIT_MOD_IMAGE_HALF_SIZE 0x20000000 // 512 MiB
+#define JIT_MOD_IMAGE_ALIGNMENT 16
+
+// A range of bytes in a half of a mod image that a grug file used to occupy
+struct jit_free_range {
+	size_t offset;
+	size_t size;
+};
+
+struct jit_mod_image_half {
+	// Everything from here up to the end of the half has never been handed out
+	size_t used;
+
+	// Sorted by offset, and never adjacent to each other
+	struct jit_free_range *free_ranges;
+	size_t free_ranges_size;
+	size_t free_ranges_capacity;
+};
+
+// The machine code and data of every grug file of a mod,
+// so a mod takes three mappings, instead of every grug file taking two or more pages and two mappings
+struct jit_mod_image {
+	char *mod;
+
+	// The code is written through code_writable, and executed through code,
+	// which map the same memfd, so the code is never writable and executable at the same time
+	u8 *code;
+	u8 *code_writable;
+	struct jit_mod_image_half code_half;
+
+	u8 *data;
+	struct jit_mod_image_half data_half;
+};
+
+// Indexed by jit_dll.image_index, and protected by jit_mod_images_mutex,
+// since compilation worker threads create JIT dlls, while the main thread frees them
+static struct jit_mod_image *jit_mod_images;
+static size_t jit_mod_images_size;
+static size_t jit_mod_images_capacity;
+static mtx_t jit_mod_images_mutex;
+
+// See grug_enable_jit_mod_images()
+static bool are_jit_mod_images_enabled = false;
+
+// What dlopen() would've made of the shared object, see create_jit_dll()
+struct jit_dll {
+	// NULL if the dll is part of a mod image
+	u8 *mapping;
+	size_t mapping_size;
+
+	// Where the shared object its address 0 would've been mapped,
+	// which every offset that the linker computed is relative to
+	// The code and data sections only have a different base when the dll is part of a mod image
+	u8 *code_base;
+	u8 *data_base;
+
+	// The offset that the data sections start at, see get_jit_address()
+	size_t data_sections_offset;
+
+	// Only used when the dll is part of a mod image
+	size_t image_index;
+	struct jit_free_range code_range;
+	struct jit_free_range data_range;
+
+	const char *symbol_names[MAX_JIT_SYMBOLS];
+	void *symbol_addresses[MAX_JIT_SYMBOLS];
+	size_t symbols_size;
+};
+
+struct jit_runtime_symbol {
+	const char *name;
+	void *address;
+};
+
+// The non-game functions and variables that mods use, which would otherwise have been looked up by the dynamic linker
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+static const struct jit_runtime_symbol jit_runtime_symbols[] = {
+	{"grug_runtime_error_handler", &grug_runtime_error_handler},
+	{"grug_fn_name", &grug_fn_name},
+	{"grug_fn_path", &grug_fn_path},
+	{"grug_has_runtime_error_happened", &grug_has_runtime_error_happened},
+	{"grug_on_fns_in_safe_mode", &grug_on_fns_in_safe_mode},
+	{"grug_call_runtime_error_handler", grug_call_runtime_error_handler},
+	{"grug_is_time_limit_exceeded", grug_is_time_limit_exceeded},
+	{"grug_set_time_limit", grug_set_time_limit},
+	{"grug_get_max_rsp_addr", grug_get_max_rsp_addr},
+	{"grug_get_max_rsp", grug_get_max_rsp},
+	{"strcmp", strcmp},
+};
+#pragma GCC diagnostic pop
+
+// Indexed the same way as grug_game_functions[]
+static void *jit_game_fn_addresses[MAX_GRUG_GAME_FUNCTIONS];
+static bool are_jit_game_fn_addresses_resolved;
+
+// This has to happen on the main thread, before any compilation worker thread calls create_jit_dll()
+// Game functions that can't be found are left NULL, so only the mods that call them get an error
+static void resolve_jit_game_fn_addresses(void) {
+	if (are_jit_game_fn_addresses_resolved) {
+		return;
+	}
+
+	for (size_t i = 0; i < grug_game_functions_size; i++) {
+		char symbol[STUPID_MAX_PATH];
+		grug_assert(snprintf(symbol, sizeof(symbol), GAME_FN_PREFIX "%s", grug_game_functions[i].name) >= 0, "Filling the variable 'symbol' failed");
+
+		jit_game_fn_addresses[i] = dlsym(RTLD_DEFAULT, symbol);
+	}
+
+	are_jit_game_fn_addresses_resolved = true;
+}
+
+static void *get_jit_extern_symbol_address(const char *name) {
+	for (size_t i = 0; i < sizeof(jit_runtime_symbols) / sizeof(*jit_runtime_symbols); i++) {
+		if (streq(name, jit_runtime_symbols[i].name)) {
+			return jit_runtime_symbols[i].address;
+		}
+	}
+
+	assert(strncmp(name, GAME_FN_PREFIX, sizeof(GAME_FN_PREFIX) - 1) == 0);
+
+	struct grug_game_function *game_fn = get_grug_game_fn(name + sizeof(GAME_FN_PREFIX) - 1);
+	assert(game_fn);
+
+	void *address = jit_game_fn_addresses[game_fn - grug_game_functions];
+	grug_assert(address, "The game function '%s' could not be found, so make sure the game defines it, and was linked with -rdynamic", name);
+
+	return address;
+}
+
+// Returns SIZE_MAX if the half is full
+static size_t allocate_jit_range(struct jit_mod_image_half *half, size_t size) {
+	for (size_t i = 0; i < half->free_ranges_size; i++) {
+		struct jit_free_range *range = &half->free_ranges[i];
+
+		if (range->size >= size) {
+			size_t offset = range->offset;
+
+			range->offset += size;
+			range->size -= size;
+
+			if (range->size == 0) {
+				half->free_ranges_size--;
+				memmove(range, range + 1, (half->free_ranges_size - i) * sizeof(*range));
+			}
+
+			return offset;
+		}
+	}
+
+	if (size > JIT_MOD_IMAGE_HALF_SIZE - half->used) {
+		return SIZE_MAX;
+	}
+
+	size_t offset = half->used;
+	half->used += size;
+	return offset;
+}
+
+// The range is leaked when the free ranges can't grow, since free_jit_dll() can't report errors
+static void free_jit_range(struct jit_mod_image_half *half, struct jit_free_range freed) {
+	// Find the first free range that comes after the freed range
+	size_t i = 0;
+	size_t end = half->free_ranges_size;
+	while (i < end) {
+		size_t middle = i + (end - i) / 2;
+		if (half->free_ranges[middle].offset < freed.offset) {
+			i = middle + 1;
+		} else {
+			end = middle;
+		}
+	}
+
+	if (i > 0) {
+		struct jit_free_range *previous = &half->free_ranges[i - 1];
+
+		if (previous->offset + previous->size == freed.offset) {
+			freed.offset = previous->offset;
+			freed.size += previous->size;
+
+			i--;
+			half->free_ranges_size--;
+			memmove(previous, previous + 1, (half->free_ranges_size - i) * sizeof(*previous));
+		}
+	}
+
+	if (i < half->free_ranges_size) {
+		struct jit_free_range *next = &half->free_ranges[i];
+
+		if (freed.offset + freed.size == next->offset) {
+			freed.size += next->size;
+
+			half->free_ranges_size--;
+			memmove(next, next + 1, (half->free_ranges_size - i) * sizeof(*next));
+		}
+	}
+
+	// The bytes at the end of the half are handed out again without needing a free range
+	if (freed.offset + freed.size == half->used) {
+		half->used = freed.offset;
+		return;
+	}
+
+	if (half->free_ranges_size >= half->free_ranges_capacity) {
+		size_t capacity = half->free_ranges_capacity == 0 ? 1 : half->free_ranges_capacity * 2;
+
+		struct jit_free_range *free_ranges = realloc(half->free_ranges, capacity * sizeof(*free_ranges));
+		if (!free_ranges) {
+			return;
+		}
+
+		half->free_ranges = free_ranges;
+		half->free_ranges_capacity = capacity;
+	}
+
+	memmove(half->free_ranges + i + 1, half->free_ranges + i, (half->free_ranges_size - i) * sizeof(*half->free_ranges));
+	half->free_ranges[i] = freed;
+	half->free_ranges_size++;
+}
+
+// Returns whether an error occurred, in which case errno is set
+// The memfd is closed right away, since the mappings keep it alive
+static bool map_jit_mod_image(struct jit_mod_image *image) {
+	u8 *reserved = mmap(NULL, 2 * JIT_MOD_IMAGE_HALF_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (reserved == MAP_FAILED) {
+		return true;
+	}
+
+	int fd = memfd_create("grug_jit_mod_image", MFD_CLOEXEC);
+	bool failed = fd == -1 || ftruncate(fd, JIT_MOD_IMAGE_HALF_SIZE) == -1;
+
+	if (!failed) {
+		image->code = mmap(reserved, JIT_MOD_IMAGE_HALF_SIZE, PROT_READ | PROT_EXEC, MAP_SHARED | MAP_FIXED, fd, 0);
+		failed = image->code == MAP_FAILED;
+	}
+
+	if (!failed) {
+		image->code_writable = mmap(NULL, JIT_MOD_IMAGE_HALF_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		failed = image->code_writable == MAP_FAILED;
+	}
+
+	if (!failed) {
+		image->data = mmap(reserved + JIT_MOD_IMAGE_HALF_SIZE, JIT_MOD_IMAGE_HALF_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+		failed = image->data == MAP_FAILED;
+	}
+
+	int saved_errno = errno;
+
+	if (failed) {
+		if (image->code_writable && image->code_writable != MAP_FAILED) {
+			munmap(image->code_writable, JIT_MOD_IMAGE_HALF_SIZE);
+		}
+		munmap(reserved, 2 * JIT_MOD_IMAGE_HALF_SIZE);
+
+		// get_jit_mod_image_index() maps the image again on the next call
+		image->code = NULL;
+		image->code_writable = NULL;
+		image->data = NULL;
+	}
+
+	if (fd != -1) {
+		close(fd);
+	}
+
+	errno = saved_errno;
+	return failed;
+}
+
+// Called once every grug file of the mod has been freed, like after the mod was removed,
+// so the mod doesn't keep its 1 GiB reservation and memfd
+// The entry stays in jit_mod_images, since the indices of the other images mustn't change
+static void unmap_jit_mod_image(struct jit_mod_image *image) {
+	// The code and data halves are adjacent, since they were mapped into one reservation
+	(void)munmap(image->code, 2 * JIT_MOD_IMAGE_HALF_SIZE);
+	(void)munmap(image->code_writable, JIT_MOD_IMAGE_HALF_SIZE);
+
+	free(image->code_half.free_ranges);
+	free(image->data_half.free_ranges);
+
+	*image = (struct jit_mod_image){.mod = image->mod};
+}
+
+// Returns SIZE_MAX if an error occurred, in which case errno is set
+// Has to be called while jit_mod_images_mutex is locked
+static size_t get_jit_mod_image_index(const char *mod_name) {
+	for (size_t i = 0; i < jit_mod_images_size; i++) {
+		if (streq(jit_mod_images[i].mod, mod_name)) {
+			// The mod was removed and added back, see unmap_jit_mod_image()
+			if (!jit_mod_images[i].code && map_jit_mod_image(&jit_mod_images[i])) {
+				return SIZE_MAX;
+			}
+
+			return i;
+		}
+	}
+
+	if (jit_mod_images_size >= jit_mod_images_capacity) {
+		size_t capacity = jit_mod_images_capacity == 0 ? 1 : jit_mod_images_capacity * 2;
+
+		struct jit_mod_image *images = realloc(jit_mod_images, capacity * sizeof(*images));
+		if (!images) {
+			return SIZE_MAX;
+		}
+
+		jit_mod_images = images;
+		jit_mod_images_capacity = capacity;
+	}
+
+	struct jit_mod_image image = {0};
+
+	image.mod = strdup(mod_name);
+	if (!image.mod) {
+		return SIZE_MAX;
+	}
+
+	if (map_jit_mod_image(&image)) {
+		int saved_errno = errno;
+		free(image.mod);
+		errno = saved_errno;
+		return SIZE_MAX;
+	}
+
+	jit_mod_images[jit_mod_images_size] = image;
+	return jit_mod_images_size++;
+}
+
+// This doesn't throw, since it's also called by discard_compilation_jobs() and while a grug_error is being thrown,
+// so a mapping that munmap() fails to unmap is leaked, just like a range that free_jit_range() can't free
+static void free_jit_dll(struct jit_dll *dll) {
+	if (dll->mapping) {
+		(void)munmap(dll->mapping, dll->mapping_size);
+	}
+
+	// A zero size means that no ranges were allocated, which happens when create_jit_dll() fails halfway
+	if (!dll->mapping && dll->code_range.size > 0) {
+		mtx_lock(&jit_mod_images_mutex);
+
+		struct jit_mod_image *image = &jit_mod_images[dll->image_index];
+
+		free_jit_range(&image->code_half, dll->code_range);
+		free_jit_range(&image->data_half, dll->data_range);
+
+		if (image->code_half.used == 0 && image->data_half.used == 0) {
+			unmap_jit_mod_image(image);
+		}
+
+		mtx_unlock(&jit_mod_images_mutex);
+	}
+
+	free(dll);
+}
+
+// Translates an offset that the linker computed into where it was mapped
+static u8 *get_jit_address(struct jit_dll *dll, size_t offset) {
+	if (offset < dll->data_sections_offset) {
+		return dll->code_base + offset;
+	}
+	return dll->data_base + offset;
+}
+
+static void relocate_jit_address(struct jit_dll *dll, size_t offset) {
+	u64 *address = (u64 *)get_jit_address(dll, offset);
+	*address = (u64)get_jit_address(dll, *address);
+}
+
+static void relocate_jit_dll(struct jit_dll *dll) {
+	// This does what the dynamic linker does with .rela.dyn, see patch_rela_dyn()
+	size_t on_fn_data_offset = data_offset + sizeof(u64);
+	for (size_t i = 0; i < grug_entity->on_function_count; i++) {
+		if (get_on_fn(grug_entity->on_functions[i].name)) {
+			relocate_jit_address(dll, on_fn_data_offset);
+		}
+		on_fn_data_offset += sizeof(size_t);
+	}
+
+	for (size_t i = 0; i < resources_size; i++) {
+		relocate_jit_address(dll, resources_offset + i * sizeof(u64));
+	}
+
+	for (size_t i = 0; i < entity_dependencies_size; i++) {
+		relocate_jit_address(dll, entities_offset + i * sizeof(u64));
+		relocate_jit_address(dll, entity_types_offset + i * sizeof(u64));
+	}
+
+	for (size_t i = 0; i < extern_data_symbols_size; i++) {
+		const char *name = symbols[first_extern_data_symbol_index + i];
+		*(void **)get_jit_address(dll, got_offset + get_global_variable_offset(name)) = get_jit_extern_symbol_address(name);
+	}
+
+	// This does what the dynamic linker does with .rela.plt,
+	// except that every function is bound immediately, so .plt its lazy binding stub is never used
+	// The .got.plt entries are in the same order as the .plt entries, see patch_plt()
+	size_t got_plt_fn_offset = got_plt_offset + GOT_PLT_INTRO_SIZE;
+	for (size_t i = 0; i < BFD_HASH_BUCKET_SIZE; i++) {
+		u32 chain_index = buckets_used_extern_fns[i];
+
+		while (chain_index != UINT32_MAX) {
+			*(void **)get_jit_address(dll, got_plt_fn_offset) = get_jit_extern_symbol_address(used_extern_fns[chain_index]);
+			got_plt_fn_offset += sizeof(u64);
+
+			chain_index = chains_used_extern_fns[chain_index];
+		}
+	}
+}
+
+static void shift_rip_relative_offset(u8 *code, size_t code_offset, i64 shift) {
+	i32 rip_relative_offset;
+	memcpy(&rip_relative_offset, code + code_offset, sizeof(rip_relative_offset));
+
+	i64 shifted = rip_relative_offset + shift;
+	assert(shifted >= INT32_MIN && shifted <= INT32_MAX);
+
+	rip_relative_offset = shifted;
+	memcpy(code + code_offset, &rip_relative_offset, sizeof(rip_relative_offset));
+}
+
+// The linker put the data sections a fixed distance after the code sections,
+// so every RIP-relative offset from code to data has to be shifted, when the data is put elsewhere
+// These are the same offsets that patch_plt(), patch_strings() and patch_global_variables() overwrote
+// code points at where the byte at code_offset was copied to
+static void shift_jit_data_references(u8 *code, size_t code_offset, i64 shift) {
+	if (has_plt()) {
+		// The two .got.plt references of .plt its lazy binding stub, followed by one per .plt entry
+		size_t overwritten_address = plt_offset + sizeof(u16);
+		shift_rip_relative_offset(code, overwritten_address - code_offset, shift);
+
+		overwritten_address += sizeof(u32) + sizeof(u16);
+		shift_rip_relative_offset(code, overwritten_address - code_offset, shift);
+
+		overwritten_address += 2 * sizeof(u32) + sizeof(u16);
+
+		for (size_t i = 0; i < extern_fns_size; i++) {
+			shift_rip_relative_offset(code, overwritten_address - code_offset, shift);
+
+			overwritten_address += sizeof(u32) + sizeof(u8) + sizeof(u32) + sizeof(u8) + sizeof(u32) + sizeof(u16);
+		}
+	}
+
+	for (size_t i = 0; i < data_string_codes_size; i++) {
+		shift_rip_relative_offset(code, text_offset + data_string_codes[i].code_offset - code_offset, shift);
+	}
+
+	for (size_t i = 0; i < used_extern_global_variables_size; i++) {
+		shift_rip_relative_offset(code, text_offset + used_extern_global_variables[i].codes_offset - code_offset, shift);
+	}
+}
+
+// Copies the code and data sections into the mod image of the mod that is being compiled
+// Returns whether an error occurred, in which case errno is set
+static bool place_jit_dll_in_mod_image(struct jit_dll *dll, size_t code_offset, size_t code_end, size_t data_start, size_t data_end) {
+	// Rounding down makes the sections keep their alignment in the image
+	code_offset -= code_offset % JIT_MOD_IMAGE_ALIGNMENT;
+	data_start -= data_start % JIT_MOD_IMAGE_ALIGNMENT;
+
+	size_t code_size = round_to_power_of_2(code_end - code_offset, JIT_MOD_IMAGE_ALIGNMENT);
+	size_t data_size_in_image = round_to_power_of_2(data_end - data_start, JIT_MOD_IMAGE_ALIGNMENT);
+
+	mtx_lock(&jit_mod_images_mutex);
+
+	size_t image_index = get_jit_mod_image_index(mod);
+	if (image_index == SIZE_MAX) {
+		int saved_errno = errno;
+		mtx_unlock(&jit_mod_images_mutex);
+		errno = saved_errno;
+		return true;
+	}
+
+	struct jit_mod_image *image = &jit_mod_images[image_index];
+
+	size_t code_image_offset = allocate_jit_range(&image->code_half, code_size);
+	size_t data_image_offset = allocate_jit_range(&image->data_half, data_size_in_image);
+
+	if (code_image_offset == SIZE_MAX || data_image_offset == SIZE_MAX) {
+		if (code_image_offset != SIZE_MAX) {
+			free_jit_range(&image->code_half, (struct jit_free_range){code_image_offset, code_size});
+		}
+		if (data_image_offset != SIZE_MAX) {
+			free_jit_range(&image->data_half, (struct jit_free_range){data_image_offset, data_size_in_image});
+		}
+		mtx_unlock(&jit_mod_images_mutex);
+		errno = ENOMEM;
+		return true;
+	}
+
+	u8 *code = image->code + code_image_offset;
+	u8 *code_writable = image->code_writable + code_image_offset;
+	u8 *data = image->data + data_image_offset;
+
+	mtx_unlock(&jit_mod_images_mutex);
+
+	// The ranges aren't used by any other grug file, so they can be written without holding the mutex
+	dll->image_index = image_index;
+	dll->code_range = (struct jit_free_range){code_image_offset, code_size};
+	dll->data_range = (struct jit_free_range){data_image_offset, data_size_in_image};
+
+	dll->code_base = code - code_offset;
+	dll->data_base = data - data_start;
+
+	memcpy(data, bytes + data_start, data_end - data_start);
+
+	memcpy(code_writable, bytes + code_offset, code_end - code_offset);
+	shift_jit_data_references(code_writable, code_offset, dll->data_base - dll->code_base);
+
+	return false;
+}
+
+static void push_jit_symbol(struct jit_dll *dll, const char *name, size_t offset) {
+	assert(dll->symbols_size < MAX_JIT_SYMBOLS);
+	dll->symbol_names[dll->symbols_size] = name;
+	dll->symbol_addresses[dll->symbols_size] = get_jit_address(dll, offset);
+	dll->symbols_size++;
+}
+
+// Maps the .plt, .text, .got, .got.plt and .data sections that generate_shared_object() put in `bytes`
+// The ELF header and the sections before .plt are only there for the dynamic linker, so they are skipped
+static struct jit_dll *create_jit_dll(void) {
+	// This is done before anything gets allocated, since it can longjmp
+	for (size_t i = 0; i < extern_fns_size; i++) {
+		(void)get_jit_extern_symbol_address(used_extern_fns[i]);
+	}
+
+	struct jit_dll *dll = calloc(1, sizeof(*dll));
+	grug_assert(dll, "calloc: %s", strerror(errno));
+
+	size_t page_size = sysconf(_SC_PAGESIZE);
+
+	size_t code_offset = has_plt() ? plt_offset : text_offset;
+	size_t mapping_offset = code_offset - code_offset % page_size;
+
+	size_t data_end = data_offset + data_size;
+	assert(data_end <= bytes_size);
+
+	size_t code_end = text_offset + text_size;
+	size_t code_end_page = code_end + (page_size - code_end % page_size) % page_size;
+
+	// The linker puts .dynamic, .got, .got.plt and .data at least a page after .text, so they can be writable
+	assert(code_end_page <= dynamic_offset - dynamic_offset % page_size);
+
+	dll->data_sections_offset = dynamic_offset;
+
+	if (are_jit_mod_images_enabled) {
+		// .dynamic is only there for the dynamic linker, so it's left out
+		size_t data_start = has_got() ? got_offset : data_offset;
+
+		if (place_jit_dll_in_mod_image(dll, code_offset, code_end, data_start, data_end)) {
+			int saved_errno = errno;
+			free_jit_dll(dll);
+			grug_error("Placing the grug file in the JIT image of the mod '%s' failed: %s", mod, strerror(saved_errno));
+		}
+
+		relocate_jit_dll(dll);
+	} else {
+		dll->mapping_size = data_end - mapping_offset;
+		dll->mapping = mmap(NULL, dll->mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (dll->mapping == MAP_FAILED) {
+			dll->mapping = NULL;
+			free_jit_dll(dll);
+			grug_error("mmap: %s", strerror(errno));
+		}
+
+		dll->code_base = dll->mapping - mapping_offset;
+		dll->data_base = dll->code_base;
+
+		memcpy(dll->mapping, bytes + mapping_offset, data_end - mapping_offset);
+
+		relocate_jit_dll(dll);
+
+		if (mprotect(dll->mapping, code_end_page - mapping_offset, PROT_READ | PROT_EXEC)) {
+			int saved_errno = errno;
+			free_jit_dll(dll);
+			grug_error("mprotect: %s", strerror(saved_errno));
+		}
+	}
+
+	for (size_t i = 0; i < data_symbols_size; i++) {
+		push_jit_symbol(dll, symbols[i], get_symbol_offset(i));
+	}
+
+	size_t init_globals_symbol_index = first_used_extern_fn_symbol_index + extern_fns_size;
+	push_jit_symbol(dll, symbols[init_globals_symbol_index], get_symbol_offset(init_globals_symbol_index));
+
+	return dll;
+}
+
+// The JIT equivalent of dlsym(), which returns NULL if the symbol doesn't exist
+static void *get_jit_dll_symbol(void *dll, const char *symbol_name) {
+	struct jit_dll *jit_dll = dll;
+
+	for (size_t i = 0; i < jit_dll->symbols_size; i++) {
+		if (streq(symbol_name, jit_dll->symbol_names[i])) {
+			return jit_dll->symbol_addresses[i];
+		}
+	}
+
+	return NULL;
 }
@@ -2,26 +2,54 @@
 
 //// HOT RELOADING
 
-#define MAX_ENTITIES 420420
-#define MAX_ENTITY_STRINGS_CHARACTERS 420420
 #define MAX_ENTITY_NAME_LENGTH 420
 #define MAX_DIRECTORY_DEPTH 42
 
 USED_BY_PROGRAMS struct grug_mod_dir grug_mods;
 
-USED_BY_PROGRAMS struct grug_modified grug_reloads[MAX_RELOADS];
+USED_BY_PROGRAMS struct grug_modified *grug_reloads;
 USED_BY_PROGRAMS size_t grug_reloads_size;
+static size_t grug_reloads_capacity;
 
-static const char *entities[MAX_ENTITIES];
-static char entity_strings[MAX_ENTITY_STRINGS_CHARACTERS];
-static size_t entity_strings_size;
-static u32 buckets_entities[MAX_ENTITIES];
-static u32 chains_entities[MAX_ENTITIES];
-static struct grug_file entity_files[MAX_ENTITIES];
+// The entity index persists across regenerate calls, and is only updated for grug files that were added, reloaded or removed
+static const char **entities;
+static u32 *buckets_entities;
+static u32 *chains_entities;
+static struct grug_file *entity_files;
 static size_t entities_size;
-
-USED_BY_PROGRAMS struct grug_modified_resource grug_resource_reloads[MAX_RESOURCE_RELOADS];
+static size_t entities_capacity;
+
+// Grug files whose entity was already taken by another grug file during this regeneration
+// They're added once the walk is done, since the other grug file might have been removed or moved by then
+static struct grug_file *pending_entity_files;
+static size_t pending_entity_files_size;
+static size_t pending_entity_files_capacity;
+
+// Every entity that a loaded grug file depends on, together with the grug files that depend on it,
+// so that only the grug files whose dependencies changed need to be checked again
+struct entity_dependents {
+	char *entity;
+
+	// The entity strings of the grug files, which identify them
+	const char **dependents;
+	size_t dependents_size;
+	size_t dependents_capacity;
+};
+static struct entity_dependents *entity_dependents;
+static size_t entity_dependents_size;
+static size_t entity_dependents_capacity;
+static u32 *buckets_entity_dependents;
+static u32 *chains_entity_dependents;
+
+// The entity strings of the grug files whose dependencies need to be checked, see check_unchecked_entities()
+// The grug files that fail the check stay in here, so they're checked again by the next regenerate call
+static const char **unchecked_entities;
+static size_t unchecked_entities_size;
+static size_t unchecked_entities_capacity;
+
+USED_BY_PROGRAMS struct grug_modified_resource *grug_resource_reloads;
 USED_BY_PROGRAMS size_t grug_resource_reloads_size;
+static size_t grug_resource_reloads_capacity;
 
 USED_BY_MODS const char *grug_fn_name;
 USED_BY_MODS const char *grug_fn_path;
@@ -30,79 +58,569 @@ static bool is_grug_initialized = false;
 
 static size_t directory_depth;
 
-static void reset_regenerate_modified_mods(void) {
+// See get_trusted_dir_mtime_ns()
+#define MIN_TRUSTED_DIR_MTIME_AGE_NS 2000000000LL // 2 seconds, since FAT stores mtimes with a 2 second granularity
+
+#define INOTIFY_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+// -1 means that polling is used, see grug_enable_inotify()
+static int inotify_fd = -1;
+
+// Only cleared after a full reload_modified_mods() succeeded,
+// so that a mod containing an error keeps being rescanned, just like with polling
+static bool are_mods_dirty = true;
+
+// Background regeneration leaves grug files that were modified after the background thread scanned them to its next scan,
+// in which case the mods stay dirty, see reload_grug_file()
+static bool are_grug_files_deferred = false;
+
+// Set when a deferred grug file isn't in its directory yet,
+// in which case the next scan can't trust the mtime of the directory to know that the grug file is missing
+static bool is_new_grug_file_deferred = false;
+
+// See grug_regenerate_modified_mods_step()
+static bool is_regeneration_step_pending = false;
+static struct grug_error step_compilation_error;
+
+// See grug_enable_background_regeneration()
+enum background_state {
+	BACKGROUND_STARTING,
+	BACKGROUND_FAILED,
+	BACKGROUND_IDLE,
+
+	// The background thread owns the compilation jobs, the build cache and the grug_mods tree
+	// The calling thread of grug_regenerate_modified_mods() must not touch them in this state
+	BACKGROUND_COMPILING,
+
+	BACKGROUND_COMPILED,
+};
+static bool is_background_regeneration_enabled = false;
+static enum background_state background_state = BACKGROUND_STARTING;
+static mtx_t background_mutex;
+static cnd_t background_cnd;
+
+// See grug_report_quiescent_state()
+#define MAX_READER_THREADS 420
+static atomic_uint_least64_t reclamation_epoch;
+static atomic_uint_least64_t reader_epochs[MAX_READER_THREADS];
+static atomic_bool are_reader_slots_taken[MAX_READER_THREADS];
+static thread_local size_t reader_thread_index = SIZE_MAX;
+
+// One past the highest slot that was ever taken, since the slots after it have never been given an epoch
+static atomic_size_t reader_threads_size;
+
+// Dlls that reader threads might still be running on_ fns of,
+// and published entity tables and grug files that they might still be reading, see publish_entities()
+struct retired_object {
+	void *dll;
+	int dll_fd;
+	void *allocation;
+	u64 epoch;
+};
+static struct retired_object *retired_objects;
+static size_t retired_objects_size;
+static size_t retired_objects_capacity;
+
+// What grug_get_entity_file() looks entities up in with background regeneration,
+// since the entity index can be reallocated by the calling thread while reader threads look entities up
+// The table and the grug files it points to never change, and are only replaced as a whole
+struct published_entities {
+	struct grug_file **files;
+	u32 *buckets;
+	u32 *chains;
+	size_t size;
+	size_t buckets_size;
+};
+static _Atomic(struct published_entities *) published_entities;
+
+// Increment this whenever grug changes the dlls it generates,
+// so that the build cache doesn't reuse dlls that an older grug generated
+#define BUILD_CACHE_VERSION 3
+
+#define BUILD_CACHE_FILENAME "grug_build_cache.txt"
+
+static bool is_build_cache_enabled = false;
+static bool is_build_cache_loaded = false;
+static bool is_build_cache_dirty = false;
+
+// See grug_enable_build_cache()
+struct build_cache_entry {
+	char *grug_path;
+	u64 content_hash;
+	i64 grug_mtime;
+
+	// What the grug file used from mod_api.json, see hash_mod_api_dependencies()
+	u64 mod_api_hash;
+	char *entity_type;
+	char *game_fn_names;
+
+	bool seen;
+};
+static struct build_cache_entry *build_cache_entries;
+static size_t build_cache_entries_size;
+static size_t build_cache_entries_capacity;
+static u32 *buckets_build_cache_entries;
+static u32 *chains_build_cache_entries;
+
+static u64 mod_api_json_hash;
+
+// Every distinct resource path that the loaded grug files reference,
+// so that a texture shared by hundreds of entities is only stat()ed once per regeneration
+struct indexed_resource {
+	char *path;
+
+	// -1 until the resource is stat()ed for the first time
+	i64 mtime;
+
+	// The number of loaded grug files that reference this resource
+	u32 reference_count;
+
+	// The resource was already checked during this regeneration if this equals resource_scan_generation
+	u64 scan_generation;
+};
+static struct indexed_resource *indexed_resources;
+static size_t indexed_resources_size;
+static size_t indexed_resources_capacity;
+static u32 *buckets_indexed_resources;
+static u32 *chains_indexed_resources;
+
+// Unreferenced resources are freed, and their slots are linked through chains_indexed_resources for reuse
+static u32 first_free_indexed_resource = UINT32_MAX;
+
+static u64 resource_scan_generation;
+
+// See grug_enable_in_memory_dlls()
+static bool are_dlls_in_memory = false;
+static bool are_dlls_written_to_disk = true;
+
+// See grug_enable_lazy_loading()
+static bool is_lazy_loading_enabled = false;
+
+// Makes reload_grug_file() load the grug file, even though lazy loading is enabled, see load_entity_file()
+static bool is_entity_file_being_loaded = false;
+
+// What compile_grug_file() produced
+struct compiled_grug_file {
+	u64 content_hash;
+
+	// A hash of the generated dll, see grug_file._dll_hash
+	u64 dll_hash;
+
+	// Whether the generated dll is identical to the loaded one, in which case no new dll was written, opened or mapped
+	bool is_dll_unchanged;
+
+	// NULL, unless the build cache is used
+	// These are the comma-separated game functions that the grug file calls, see hash_mod_api_dependencies()
+	char *game_fn_names;
+	u64 mod_api_hash;
+
+	// -1, unless the dll was generated in memory
+	int dll_fd;
+
+	// NULL, unless the dll was JITted
+	struct jit_dll *jit_dll;
+};
+
+#define MAX_COMPILATION_THREADS 420
+
+// 1 means that the calling thread compiles every grug file itself, see grug_set_compilation_thread_count()
+static size_t compilation_thread_count = 1;
+
+struct compilation_job {
+	char *grug_path;
+	char *dll_path;
+	char *mod;
+	const char *grug_filename;
+
+	// The dll hash of the grug file when the job was queued, see compile_grug_file()
+	u64 loaded_dll_hash;
+
+	// The mtime of the grug file right before it was compiled
+	// The job isn't used when the grug file has been modified since, see reload_grug_file()
+	i64 grug_mtime;
+
+	bool is_compiled;
+	bool is_used;
+
+	bool is_loading_error_in_grug_file;
+	struct grug_error *error;
+
+	struct compiled_grug_file compiled;
+};
+static struct compilation_job *compilation_jobs;
+static size_t compilation_jobs_size;
+static size_t compilation_jobs_capacity;
+static u32 *buckets_compilation_jobs;
+static u32 *chains_compilation_jobs;
+
+static size_t next_compilation_job_index;
+static mtx_t compilation_jobs_mutex;
+
+static thrd_t compilation_threads[MAX_COMPILATION_THREADS];
+
+// Every array that compiling a grug file writes to
+// Each compilation worker thread allocates its own copy of them, see allocate_worker_arrays()
+#define WORKER_ARRAYS\
+	X(grug_text)\
+	X(tokens)\
+	X(token_strings)\
+	X(exprs)\
+	X(statements)\
+	X(global_statements)\
+	X(arguments)\
+	X(on_fns)\
+	X(helper_fns)\
+	X(buckets_helper_fns)\
+	X(chains_helper_fns)\
+	X(global_variable_statements)\
+	X(called_helper_fn_names)\
+	X(buckets_called_helper_fn_names)\
+	X(chains_called_helper_fn_names)\
+	X(variables)\
+	X(buckets_variables)\
+	X(chains_variables)\
+	X(global_variables)\
+	X(buckets_global_variables)\
+	X(chains_global_variables)\
+	X(reassigned_global_variables)\
+	X(buckets_entity_on_fns)\
+	X(chains_entity_on_fns)\
+	X(file_entity_type)\
+	X(entity_types)\
+	X(data_strings)\
+	X(buckets_data_strings)\
+	X(chains_data_strings)\
+	X(text_offsets)\
+	X(codes)\
+	X(resource_strings)\
+	X(entity_dependency_strings)\
+	X(data_string_codes)\
+	X(extern_fn_calls)\
+	X(helper_fn_calls)\
+	X(used_extern_global_variables)\
+	X(used_extern_fns)\
+	X(buckets_used_extern_fns)\
+	X(chains_used_extern_fns)\
+	X(used_extern_fn_symbols)\
+	X(helper_fn_offsets)\
+	X(buckets_helper_fn_offsets)\
+	X(chains_helper_fn_offsets)\
+	X(start_of_loop_jump_offsets)\
+	X(loop_break_statements_stack)\
+	X(resources)\
+	X(entity_dependencies)\
+	X(helper_fn_mode_names)\
+	X(symbols)\
+	X(symbol_name_dynstr_offsets)\
+	X(symbol_name_strtab_offsets)\
+	X(buckets_on_fns)\
+	X(chains_on_fns)\
+	X(shuffled_symbols)\
+	X(buckets_shuffled_symbols)\
+	X(chains_shuffled_symbols)\
+	X(shuffled_symbol_index_to_symbol_index)\
+	X(symbol_index_to_shuffled_symbol_index)\
+	X(data_offsets)\
+	X(data_string_offsets)\
+	X(buckets_hash)\
+	X(chains_hash)\
+	X(bytes)\
+	X(game_fn_offsets)\
+	X(buckets_game_fn_offsets)\
+	X(chains_game_fn_offsets)\
+	X(global_variable_offsets)\
+	X(buckets_global_variable_offsets)\
+	X(chains_global_variable_offsets)
+
+// The arrays keep their capacity, but the paths only live until the next regenerate call
+static void clear_reloads(void) {
+	for (size_t i = 0; i < grug_reloads_size; i++) {
+		free((void *)grug_reloads[i].path);
+	}
 	grug_reloads_size = 0;
-	entity_strings_size = 0;
-	memset(buckets_entities, 0xff, sizeof(buckets_entities));
-	entities_size = 0;
+
+	for (size_t i = 0; i < grug_resource_reloads_size; i++) {
+		free((void *)grug_resource_reloads[i].path);
+	}
 	grug_resource_reloads_size = 0;
+}
+
+static void push_resource_reload(const char *resource_path) {
+	if (grug_resource_reloads_size >= grug_resource_reloads_capacity) {
+		grug_resource_reloads_capacity = grug_resource_reloads_capacity == 0 ? 1 : grug_resource_reloads_capacity * 2;
+		grug_resource_reloads = realloc(grug_resource_reloads, grug_resource_reloads_capacity * sizeof(*grug_resource_reloads));
+		grug_assert(grug_resource_reloads, "realloc: %s", strerror(errno));
+	}
+
+	const char *path = strdup(resource_path);
+	grug_assert(path, "strdup: %s", strerror(errno));
+
+	grug_resource_reloads[grug_resource_reloads_size++] = (struct grug_modified_resource){.path = path};
+}
+
+static void reset_reloads(void) {
+	clear_reloads();
+	pending_entity_files_size = 0;
+	resource_scan_generation++;
 	grug_fn_name = "OPTIMIZED OUT FUNCTION NAME";
 	grug_fn_path = "OPTIMIZED OUT FUNCTION PATH";
 	directory_depth = 0;
 }
 
-static void reload_resources_from_dll(const char *dll_path, i64 *resource_mtimes, size_t dll_resources_size) {
-	void *dll = dlopen(dll_path, RTLD_NOW);
-	if (!dll) {
-		print_dlerror("dlopen");
+static void rehash_indexed_resources(void) {
+	memset(buckets_indexed_resources, 0xff, indexed_resources_capacity * sizeof(u32));
 
-		// Needed for clang's --analyze, since it doesn't recognize
-		// that print_dlerror() its longjmp guarantees that `dll`
-		// will always be non-null when this if-statement has *not* been entered
-		return;
+	for (size_t i = 0; i < indexed_resources_size; i++) {
+		u32 bucket_index = elf_hash(indexed_resources[i].path) % indexed_resources_capacity;
+
+		chains_indexed_resources[i] = buckets_indexed_resources[bucket_index];
+
+		buckets_indexed_resources[bucket_index] = i;
+	}
+}
+
+// Returns the index of the resource, adding it to the index if no loaded grug file referenced it yet
+static u32 index_resource(const char *path) {
+	if (indexed_resources_capacity > 0) {
+		u32 i = buckets_indexed_resources[elf_hash(path) % indexed_resources_capacity];
+
+		while (i != UINT32_MAX) {
+			if (streq(path, indexed_resources[i].path)) {
+				indexed_resources[i].reference_count++;
+				return i;
+			}
+
+			i = chains_indexed_resources[i];
+		}
+	}
+
+	char *path_copy = strdup(path);
+	grug_assert(path_copy, "strdup: %s", strerror(errno));
+
+	u32 i;
+	if (first_free_indexed_resource != UINT32_MAX) {
+		i = first_free_indexed_resource;
+		first_free_indexed_resource = chains_indexed_resources[i];
+	} else {
+		// Since the free slots are all used up, every slot is in use when rehashing
+		if (indexed_resources_size >= indexed_resources_capacity) {
+			indexed_resources_capacity = indexed_resources_capacity == 0 ? 1 : indexed_resources_capacity * 2;
+
+			indexed_resources = realloc(indexed_resources, indexed_resources_capacity * sizeof(*indexed_resources));
+			grug_assert(indexed_resources, "realloc: %s", strerror(errno));
+
+			buckets_indexed_resources = realloc(buckets_indexed_resources, indexed_resources_capacity * sizeof(u32));
+			grug_assert(buckets_indexed_resources, "realloc: %s", strerror(errno));
+
+			chains_indexed_resources = realloc(chains_indexed_resources, indexed_resources_capacity * sizeof(u32));
+			grug_assert(chains_indexed_resources, "realloc: %s", strerror(errno));
+
+			rehash_indexed_resources();
+		}
+
+		i = indexed_resources_size++;
 	}
 
-	const char **dll_resources = get_dll_symbol(dll, "resources");
-	if (!dll_resources) {
-		if (dlclose(dll)) {
-			print_dlerror("dlclose");
+	indexed_resources[i] = (struct indexed_resource){
+		.path = path_copy,
+		.mtime = -1,
+		.reference_count = 1,
+	};
+
+	u32 bucket_index = elf_hash(path) % indexed_resources_capacity;
+	chains_indexed_resources[i] = buckets_indexed_resources[bucket_index];
+	buckets_indexed_resources[bucket_index] = i;
+
+	return i;
+}
+
+static void unindex_resources(u32 *file_resources, size_t file_resources_size) {
+	for (size_t i = 0; i < file_resources_size; i++) {
+		struct indexed_resource *resource = &indexed_resources[file_resources[i]];
+
+		assert(resource->reference_count > 0);
+		if (--resource->reference_count > 0) {
+			continue;
+		}
+
+		u32 *link = &buckets_indexed_resources[elf_hash(resource->path) % indexed_resources_capacity];
+		while (*link != file_resources[i]) {
+			link = &chains_indexed_resources[*link];
 		}
-		grug_error("Retrieving resources with get_dll_symbol() failed for %s", dll_path);
+		*link = chains_indexed_resources[file_resources[i]];
+
+		free(resource->path);
+		resource->path = NULL;
+
+		chains_indexed_resources[file_resources[i]] = first_free_indexed_resource;
+		first_free_indexed_resource = file_resources[i];
 	}
+}
 
-	for (size_t i = 0; i < dll_resources_size; i++) {
-		const char *resource = dll_resources[i];
+// Let the game developer know when they need to reload a resource
+static void reload_resources(struct grug_file *file) {
+	for (size_t i = 0; i < file->_resources_size; i++) {
+		struct indexed_resource *resource = &indexed_resources[file->_resources[i]];
+
+		if (resource->scan_generation == resource_scan_generation) {
+			continue;
+		}
+		resource->scan_generation = resource_scan_generation;
 
 		struct stat resource_stat;
-		if (stat(resource, &resource_stat) == -1) {
-			if (dlclose(dll)) {
-				print_dlerror("dlclose");
+		grug_assert(stat(resource->path, &resource_stat) == 0, "%s: %s", resource->path, strerror(errno));
+
+		bool is_first_stat = resource->mtime == -1;
+
+		if (resource_stat.st_mtime > resource->mtime) {
+			resource->mtime = resource_stat.st_mtime;
+
+			if (is_first_stat) {
+				continue;
 			}
-			grug_error("%s: %s", resource, strerror(errno));
+
+			push_resource_reload(resource->path);
 		}
+	}
+}
 
-		if (resource_stat.st_mtime > resource_mtimes[i]) {
-			resource_mtimes[i] = resource_stat.st_mtime;
+// The memfd is named after the dll, which shows up in /proc/self/maps
+static int create_dll_memfd(const char *dll_path) {
+	const char *dll_filename = strrchr(dll_path, '/');
+	dll_filename = dll_filename ? dll_filename + 1 : dll_path;
 
-			struct grug_modified_resource modified = {0};
+	int fd = memfd_create(dll_filename, MFD_CLOEXEC);
+	grug_assert(fd != -1, "memfd_create: %s", strerror(errno));
 
-			grug_assert(strlen(resource) + 1 <= sizeof(modified.path), "The resource '%s' exceeds the maximum path length of %zu", resource, sizeof(modified.path));
-			memcpy(modified.path, resource, strlen(resource) + 1);
+	for (size_t written = 0; written < bytes_size;) {
+		ssize_t bytes_written = write(fd, bytes + written, bytes_size - written);
+		if (bytes_written == -1) {
+			close(fd);
+			grug_error("write: %s", strerror(errno));
+		}
+		written += bytes_written;
+	}
 
-			if (grug_resource_reloads_size >= MAX_RESOURCE_RELOADS) {
-				if (dlclose(dll)) {
-					print_dlerror("dlclose");
-				}
-				grug_error("There are more than %d modified resources, exceeding MAX_RESOURCE_RELOADS", MAX_RESOURCE_RELOADS);
-			}
+	return fd;
+}
+
+static u64 hash_string(u64 hash, const char *str) {
+	// The null terminator separates the strings, so "ab" + "c" and "a" + "bc" hash differently
+	return fnv_1a_hash(hash, str, strlen(str) + 1);
+}
+
+static u64 hash_arguments(u64 hash, struct argument *fn_arguments, size_t argument_count) {
+	for (size_t i = 0; i < argument_count; i++) {
+		struct argument argument = fn_arguments[i];
 
-			grug_resource_reloads[grug_resource_reloads_size++] = modified;
+		hash = hash_string(hash, argument.name);
+		hash = hash_string(hash, argument.type_name);
+
+		if (argument.type == type_resource && argument.resource_extension) {
+			hash = hash_string(hash, argument.resource_extension);
+		} else if (argument.type == type_entity && argument.entity_type) {
+			hash = hash_string(hash, argument.entity_type);
 		}
 	}
 
-	if (dlclose(dll)) {
-		print_dlerror("dlclose");
+	return hash;
+}
+
+// Returns the hash of the parts of mod_api.json that a grug file was compiled against,
+// which are its entity type, and the game functions that it calls
+// This is how the build cache recompiles only the grug files whose parts of mod_api.json changed
+// Returns 0 if the entity type or one of the game functions isn't in mod_api.json anymore
+static u64 hash_mod_api_dependencies(const char *entity_type, const char *game_fn_names) {
+	struct grug_entity *entity = get_grug_entity(entity_type);
+	if (!entity) {
+		return 0;
 	}
+
+	u64 hash = hash_string(FNV_1A_OFFSET_BASIS, entity->name);
+
+	for (size_t i = 0; i < entity->on_function_count; i++) {
+		struct grug_on_function on_fn = entity->on_functions[i];
+
+		hash = hash_string(hash, on_fn.name);
+		hash = hash_arguments(hash, on_fn.arguments, on_fn.argument_count);
+	}
+
+	while (*game_fn_names) {
+		size_t name_length = strcspn(game_fn_names, ",");
+
+		char name[STUPID_MAX_PATH];
+		if (name_length >= sizeof(name)) {
+			return 0;
+		}
+		memcpy(name, game_fn_names, name_length);
+		name[name_length] = '\0';
+
+		struct grug_game_function *game_fn = get_grug_game_fn(name);
+		if (!game_fn) {
+			return 0;
+		}
+
+		hash = hash_string(hash, game_fn->name);
+		hash = hash_string(hash, game_fn->return_type_name ? game_fn->return_type_name : "");
+		hash = hash_arguments(hash, game_fn->arguments, game_fn->argument_count);
+
+		game_fn_names += name_length;
+		if (*game_fn_names == ',') {
+			game_fn_names++;
+		}
+	}
+
+	return hash;
+}
+
+// Returns the comma-separated names of the game functions that the grug file that was just compiled calls
+static char *get_used_game_fn_names(void) {
+	size_t prefix_length = sizeof(GAME_FN_PREFIX) - 1;
+
+	size_t size = 1;
+	for (size_t i = 0; i < extern_fns_size; i++) {
+		if (strncmp(used_extern_fns[i], GAME_FN_PREFIX, prefix_length) == 0) {
+			size += strlen(used_extern_fns[i]) - prefix_length + 1;
+		}
+	}
+
+	char *names = malloc(size);
+	grug_assert(names, "malloc: %s", strerror(errno));
+
+	char *end = names;
+	for (size_t i = 0; i < extern_fns_size; i++) {
+		if (strncmp(used_extern_fns[i], GAME_FN_PREFIX, prefix_length) == 0) {
+			if (end != names) {
+				*end++ = ',';
+			}
+
+			const char *name = used_extern_fns[i] + prefix_length;
+			size_t name_length = strlen(name);
+
+			memcpy(end, name, name_length);
+			end += name_length;
+		}
+	}
+	*end = '\0';
+
+	return names;
 }
 
-static void regenerate_dll(const char *grug_path, const char *dll_path) {
+static bool is_build_cache_used(void);
+
+// The dll is written to dll_path if write_to_disk is true,
+// to a memfd if in_memory is true, and mapped by create_jit_dll() if jit is true
+// None of that happens when the dll is identical to the loaded dll, whose hash is loaded_dll_hash, or 0 if it isn't loaded
+static struct compiled_grug_file compile_and_link_grug_file(const char *grug_path, const char *dll_path, u64 loaded_dll_hash, bool write_to_disk, bool in_memory, bool jit) {
 	grug_log("# Regenerating %s\n", dll_path);
 
-	grug_loading_error_in_grug_file = true;
+	struct compiled_grug_file compiled = {.dll_fd = -1};
 
 	read_file(grug_path);
 	grug_log("\n# Read text\n%s", grug_text);
 
+	compiled.content_hash = fnv_1a_hash(FNV_1A_OFFSET_BASIS, grug_text, strlen(grug_text));
+
 	tokenize();
 	grug_log("\n# Tokens\n");
 #ifdef LOGGING
@@ -114,12 +632,134 @@ static void regenerate_dll(const char *grug_path, const char *dll_path) {
 	parse();
 	fill_result_types();
 
+	if (are_optimizations_enabled) {
+		fold_constants();
+	}
+
 	compile(grug_path);
 
 	grug_log("\n# Section offsets\n");
-	generate_shared_object(dll_path);
+	generate_shared_object(NULL);
+
+	compiled.dll_hash = fnv_1a_hash(FNV_1A_OFFSET_BASIS, bytes, bytes_size);
+
+	// Editing a comment or blank line usually doesn't change the dll, so the loaded dll is kept
+	// The dll on disk only has its mtime updated, so it isn't seen as outdated by the next regenerate
+	if (loaded_dll_hash != 0 && compiled.dll_hash == loaded_dll_hash) {
+		compiled.is_dll_unchanged = !write_to_disk || utimensat(AT_FDCWD, dll_path, NULL, 0) == 0;
+	}
+
+	if (!compiled.is_dll_unchanged) {
+		if (write_to_disk) {
+			write_shared_object(dll_path);
+		}
+
+		if (in_memory) {
+			compiled.dll_fd = create_dll_memfd(dll_path);
+		}
+
+		if (jit) {
+			compiled.jit_dll = create_jit_dll();
+		}
+	}
+
+	// This happens last, since nothing frees the names when an error longjmps out of this function
+	if (is_build_cache_used()) {
+		compiled.game_fn_names = get_used_game_fn_names();
+		compiled.mod_api_hash = hash_mod_api_dependencies(file_entity_type, compiled.game_fn_names);
+	}
+
+	return compiled;
+}
+
+static i64 get_mtime_ns(struct stat *entry_stat) {
+	return entry_stat->st_mtim.tv_sec * 1000000000LL + entry_stat->st_mtim.tv_nsec;
+}
+
+// Returns whether the dll was written after the grug file was last modified, which means another process
+// that shares the dll directory generated it while this process was waiting for the lock in compile_grug_file()
+static bool is_dll_generated_by_other_process(int grug_fd, const char *dll_path) {
+	struct stat grug_stat;
+	grug_assert(fstat(grug_fd, &grug_stat) == 0, "fstat: %s", strerror(errno));
+
+	// errno is reset, since the readdir() loop of reload_changed_dir() checks it
+	struct stat dll_stat;
+	if (stat(dll_path, &dll_stat) == -1) {
+		errno = 0;
+		return false;
+	}
+
+	return get_mtime_ns(&dll_stat) >= get_mtime_ns(&grug_stat);
+}
+
+// Uses the dll that another process generated, instead of compiling the grug file again
+static struct compiled_grug_file reuse_dll(const char *dll_path, u64 loaded_dll_hash, bool in_memory) {
+	grug_log("# Reusing %s\n", dll_path);
+
+	struct compiled_grug_file compiled = {.dll_fd = -1};
+
+	read_shared_object(dll_path);
+
+	compiled.dll_hash = fnv_1a_hash(FNV_1A_OFFSET_BASIS, bytes, bytes_size);
+	compiled.is_dll_unchanged = loaded_dll_hash != 0 && compiled.dll_hash == loaded_dll_hash;
+
+	if (in_memory && !compiled.is_dll_unchanged) {
+		compiled.dll_fd = create_dll_memfd(dll_path);
+	}
+
+	return compiled;
+}
+
+// Processes that share the dll directory, like several game servers on one machine, take turns compiling a grug file,
+// by locking the grug file, so every grug file is only compiled once, and the others reuse its dll
+// This only happens when the dll is written to disk, and when the build cache is unused,
+// since only the mtime of the dll says that it was generated from the current grug file
+static struct compiled_grug_file compile_grug_file(const char *grug_path, const char *dll_path, u64 loaded_dll_hash, bool write_to_disk, bool in_memory, bool jit) {
+	if (!write_to_disk || is_build_cache_used()) {
+		return compile_and_link_grug_file(grug_path, dll_path, loaded_dll_hash, write_to_disk, in_memory, jit);
+	}
+
+	int grug_fd = open(grug_path, O_RDONLY | O_CLOEXEC);
+	grug_assert(grug_fd != -1, "open: %s: %s", grug_path, strerror(errno));
+
+	if (flock(grug_fd, LOCK_EX) == -1) {
+		close(grug_fd);
+		grug_error("flock: %s: %s", grug_path, strerror(errno));
+	}
+
+	// The lock has to be released when an error longjmps out of here,
+	// since the other processes would otherwise wait on it forever
+	jmp_buf outer_error_jmp_buffer;
+	memcpy(outer_error_jmp_buffer, error_jmp_buffer, sizeof(jmp_buf));
+
+	if (setjmp(error_jmp_buffer)) {
+		close(grug_fd);
+		memcpy(error_jmp_buffer, outer_error_jmp_buffer, sizeof(jmp_buf));
+		longjmp(error_jmp_buffer, 1);
+	}
+
+	struct compiled_grug_file compiled;
+	if (is_dll_generated_by_other_process(grug_fd, dll_path)) {
+		compiled = reuse_dll(dll_path, loaded_dll_hash, in_memory);
+	} else {
+		compiled = compile_and_link_grug_file(grug_path, dll_path, loaded_dll_hash, write_to_disk, in_memory, jit);
+	}
+
+	// Closing the grug file releases the lock
+	close(grug_fd);
+	memcpy(error_jmp_buffer, outer_error_jmp_buffer, sizeof(jmp_buf));
+
+	return compiled;
+}
+
+static struct compiled_grug_file regenerate_dll(const char *grug_path, const char *dll_path, u64 loaded_dll_hash, bool write_to_disk, bool in_memory, bool jit) {
+	grug_loading_error_in_grug_file = true;
+
+	struct compiled_grug_file compiled = compile_grug_file(grug_path, dll_path, loaded_dll_hash, write_to_disk, in_memory, jit);
 
 	grug_loading_error_in_grug_file = false;
+
+	return compiled;
 }
 
 // Resetting previous_grug_error is necessary for this edge case:
@@ -179,7 +819,11 @@ bool grug_test_regenerate_dll(const char *grug_path, const char *dll_path, const
 	grug_assert(grug_filename, "The grug file path '%s' does not contain a '/' character", grug_path);
 	initialize_file_entity_type(grug_filename + 1);
 
-	regenerate_dll(grug_path, dll_path);
+	// The grug file is always compiled, rather than reusing the dll that compile_grug_file() might find
+	grug_loading_error_in_grug_file = true;
+	struct compiled_grug_file compiled = compile_and_link_grug_file(grug_path, dll_path, 0, true, false, false);
+	grug_loading_error_in_grug_file = false;
+	free(compiled.game_fn_names);
 
 	reset_previous_grug_error();
 
@@ -204,608 +848,2839 @@ static void try_create_parent_dirs(const char *file_path) {
 	}
 }
 
-static void free_file(struct grug_file file) {
-	free((void *)file.name);
-	free((void *)file.entity);
-	free((void *)file.entity_type);
+// The build cache describes the dlls on disk, so there's nothing for it to describe when they aren't written to it
+static bool is_build_cache_used(void) {
+	return is_build_cache_enabled && are_dlls_written_to_disk;
+}
 
-	if (file.dll && dlclose(file.dll)) {
-		print_dlerror("dlclose");
+static u64 hash_file(const char *path) {
+	FILE *f = fopen(path, "rb");
+	grug_assert(f, "fopen: %s: %s", path, strerror(errno));
+
+	u64 hash = FNV_1A_OFFSET_BASIS;
+
+	u8 buffer[4096];
+	size_t bytes_read;
+	while ((bytes_read = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+		hash = fnv_1a_hash(hash, buffer, bytes_read);
 	}
+	grug_assert(!ferror(f), "fread error: %s", path);
 
-	free(file._resource_mtimes);
-}
+	grug_assert(fclose(f) == 0, "fclose: %s", strerror(errno));
 
-static void free_dir(struct grug_mod_dir dir) {
-	free((void *)dir.name);
+	return hash;
+}
 
-	for (size_t i = 0; i < dir.dirs_size; i++) {
-		free_dir(dir.dirs[i]);
+static void rehash_build_cache_entries(void) {
+	if (build_cache_entries_capacity == 0) {
+		return;
 	}
-	free(dir.dirs);
 
-	for (size_t i = 0; i < dir.files_size; i++) {
-		free_file(dir.files[i]);
+	memset(buckets_build_cache_entries, 0xff, build_cache_entries_capacity * sizeof(u32));
+
+	for (size_t i = 0; i < build_cache_entries_size; i++) {
+		u32 bucket_index = elf_hash(build_cache_entries[i].grug_path) % build_cache_entries_capacity;
+
+		chains_build_cache_entries[i] = buckets_build_cache_entries[bucket_index];
+
+		buckets_build_cache_entries[bucket_index] = i;
 	}
-	free(dir.files);
 }
 
-static u32 get_entity_index(const char *entity) {
-	if (entities_size == 0) {
-		return UINT32_MAX;
+static struct build_cache_entry *get_build_cache_entry(const char *grug_path) {
+	if (build_cache_entries_size == 0) {
+		return NULL;
 	}
 
-	u32 i = buckets_entities[elf_hash(entity) % MAX_ENTITIES];
+	u32 i = buckets_build_cache_entries[elf_hash(grug_path) % build_cache_entries_capacity];
 
 	while (true) {
 		if (i == UINT32_MAX) {
-			return UINT32_MAX;
+			return NULL;
 		}
 
-		if (streq(entity, entities[i])) {
+		if (streq(grug_path, build_cache_entries[i].grug_path)) {
 			break;
 		}
 
-		i = chains_entities[i];
+		i = chains_build_cache_entries[i];
 	}
 
-	return i;
+	return &build_cache_entries[i];
 }
 
-struct grug_file *grug_get_entity_file(const char *entity) {
-	u32 index = get_entity_index(entity);
-	if (index == UINT32_MAX) {
-		return NULL;
-	}
-	return &entity_files[index];
-}
+static void set_build_cache_entry(const char *grug_path, u64 content_hash, i64 grug_mtime, u64 mod_api_hash, const char *entity_type, const char *game_fn_names) {
+	struct build_cache_entry *entry = get_build_cache_entry(grug_path);
 
-static void check_that_every_entity_exists(struct grug_mod_dir dir) {
-	for (size_t i = 0; i < dir.files_size; i++) {
-		struct grug_file file = dir.files[i];
+	if (!entry) {
+		if (build_cache_entries_size >= build_cache_entries_capacity) {
+			build_cache_entries_capacity = build_cache_entries_capacity == 0 ? 1 : build_cache_entries_capacity * 2;
 
-		size_t *entities_size_ptr = get_dll_symbol(file.dll, "entities_size");
-		grug_assert(entities_size_ptr, "Retrieving the entities_size variable with get_dll_symbol() failed for '%s'", file.name);
+			build_cache_entries = realloc(build_cache_entries, build_cache_entries_capacity * sizeof(*build_cache_entries));
+			grug_assert(build_cache_entries, "realloc: %s", strerror(errno));
 
-		if (*entities_size_ptr > 0) {
-			const char **dll_entities = get_dll_symbol(file.dll, "entities");
-			grug_assert(entities_size_ptr, "Retrieving the dll_entities variable with get_dll_symbol() failed for '%s'", file.name);
+			buckets_build_cache_entries = realloc(buckets_build_cache_entries, build_cache_entries_capacity * sizeof(u32));
+			grug_assert(buckets_build_cache_entries, "realloc: %s", strerror(errno));
 
-			const char **dll_entity_types = get_dll_symbol(file.dll, "entity_types");
-			grug_assert(entities_size_ptr, "Retrieving the dll_entity_types variable with get_dll_symbol() failed for '%s'", file.name);
+			chains_build_cache_entries = realloc(chains_build_cache_entries, build_cache_entries_capacity * sizeof(u32));
+			grug_assert(chains_build_cache_entries, "realloc: %s", strerror(errno));
 
-			for (size_t dll_entity_index = 0; dll_entity_index < *entities_size_ptr; dll_entity_index++) {
-				const char *entity = dll_entities[dll_entity_index];
+			rehash_build_cache_entries();
+		}
 
-				u32 entity_index = get_entity_index(entity);
+		char *grug_path_copy = strdup(grug_path);
+		grug_assert(grug_path_copy, "strdup: %s", strerror(errno));
 
-				grug_assert(entity_index != UINT32_MAX, "The entity '%s' does not exist", entity);
+		u32 bucket_index = elf_hash(grug_path) % build_cache_entries_capacity;
 
-				const char *json_entity_type = dll_entity_types[dll_entity_index];
+		chains_build_cache_entries[build_cache_entries_size] = buckets_build_cache_entries[bucket_index];
 
-				struct grug_file other_file = entity_files[entity_index];
+		buckets_build_cache_entries[bucket_index] = build_cache_entries_size;
 
-				grug_assert(*json_entity_type == '\0' || streq(other_file.entity_type, json_entity_type), "The entity '%s' has the type '%s', whereas the expected type from mod_api.json is '%s'", entity, other_file.entity_type, json_entity_type);
-			}
-		}
+		entry = &build_cache_entries[build_cache_entries_size++];
+		*entry = (struct build_cache_entry){.grug_path = grug_path_copy};
 	}
 
-	for (size_t i = 0; i < dir.dirs_size; i++) {
-		check_that_every_entity_exists(dir.dirs[i]);
-	}
-}
+	char *entity_type_copy = strdup(entity_type);
+	grug_assert(entity_type_copy, "strdup: %s", strerror(errno));
+	free(entry->entity_type);
+	entry->entity_type = entity_type_copy;
 
-static void push_reload(struct grug_modified modified) {
-	grug_assert(grug_reloads_size < MAX_RELOADS, "There are more than %d modified grug files, exceeding MAX_RELOADS", MAX_RELOADS);
-	grug_reloads[grug_reloads_size++] = modified;
-}
+	char *game_fn_names_copy = strdup(game_fn_names);
+	grug_assert(game_fn_names_copy, "strdup: %s", strerror(errno));
+	free(entry->game_fn_names);
+	entry->game_fn_names = game_fn_names_copy;
 
-// Returns `mod + ':' + grug_filename - "-<entity type>.grug"`
-static const char *form_entity(const char *grug_filename) {
-	static char entity_name[MAX_ENTITY_NAME_LENGTH];
+	entry->content_hash = content_hash;
+	entry->grug_mtime = grug_mtime;
+	entry->mod_api_hash = mod_api_hash;
+	entry->seen = true;
 
-	const char *dash = strrchr(grug_filename, '-');
-	if (dash == NULL) {
-		// The function initialize_file_entity_type() already checked for a missing dash
-		grug_unreachable();
-	}
+	is_build_cache_dirty = true;
+}
 
-	size_t entity_name_length = dash - grug_filename;
+static void get_build_cache_path(char *build_cache_path) {
+	grug_assert(snprintf(build_cache_path, STUPID_MAX_PATH, "%s/" BUILD_CACHE_FILENAME, dll_root_dir_path) >= 0, "Filling the variable 'build_cache_path' failed");
+}
 
-	grug_assert(entity_name_length < MAX_ENTITY_NAME_LENGTH, "There are more than %d entity name characters in the grug filename '%s', exceeding MAX_ENTITY_NAME_LENGTH", MAX_ENTITY_NAME_LENGTH, grug_filename);
-	memcpy(entity_name, grug_filename, entity_name_length);
-	entity_name[entity_name_length] = '\0';
+// The first line is "grug_build_cache <BUILD_CACHE_VERSION> <whether optimizations are enabled> <mod_api.json hash>"
+// Every other line is "<content hash> <mtime> <mod_api.json dependencies hash> <entity type> <game functions> <grug path>",
+// where <game functions> is comma-separated, or "-" if the grug file doesn't call any
+// If the version or optimizations don't match, the whole cache is ignored, so every grug file gets recompiled
+// If only the mod_api.json hash doesn't match, only the grug files whose parts of mod_api.json changed get recompiled
+static void load_build_cache(void) {
+	is_build_cache_loaded = true;
 
-	static char entity[MAX_ENTITY_NAME_LENGTH];
-	grug_assert(snprintf(entity, sizeof(entity), "%s:%s", mod, entity_name) >= 0, "Filling the variable 'entity' failed");
+	char build_cache_path[STUPID_MAX_PATH];
+	get_build_cache_path(build_cache_path);
 
-	size_t entity_length = strlen(entity);
+	FILE *f = fopen(build_cache_path, "r");
+	if (!f) {
+		grug_assert(errno == ENOENT, "fopen: %s: %s", build_cache_path, strerror(errno));
+		return;
+	}
 
-	grug_assert(entity_strings_size + entity_length < MAX_ENTITY_STRINGS_CHARACTERS, "There are more than %d characters in the entity_strings array, exceeding MAX_ENTITY_STRINGS_CHARACTERS", MAX_ENTITY_STRINGS_CHARACTERS);
+	unsigned version;
+	int file_are_optimizations_enabled;
+	u64 file_mod_api_json_hash;
+	if (fscanf(f, "grug_build_cache %u %d %" SCNx64 "\n", &version, &file_are_optimizations_enabled, &file_mod_api_json_hash) != 3
+	 || version != BUILD_CACHE_VERSION
+	 || file_are_optimizations_enabled != are_optimizations_enabled) {
+		grug_assert(fclose(f) == 0, "fclose: %s", strerror(errno));
+		return;
+	}
 
-	char *entity_str = entity_strings + entity_strings_size;
+	bool is_mod_api_json_changed = file_mod_api_json_hash != mod_api_json_hash;
 
-	memcpy(entity_str, entity, entity_length);
-	entity_strings_size += entity_length;
-	entity_strings[entity_strings_size++] = '\0';
+	// getline() is used, since the game functions make the length of a line unbounded
+	char *line = NULL;
+	size_t line_capacity = 0;
+	while (getline(&line, &line_capacity, f) != -1) {
+		line[strcspn(line, "\n")] = '\0';
 
-	return entity_str;
-}
+		u64 content_hash;
+		i64 grug_mtime;
+		u64 mod_api_hash;
+		int entity_type_offset;
+		if (sscanf(line, "%" SCNx64 " %" SCNd64 " %" SCNx64 " %n", &content_hash, &grug_mtime, &mod_api_hash, &entity_type_offset) != 3) {
+			continue;
+		}
 
-static void add_entity(const char *grug_filename, struct grug_file *file) {
-	grug_assert(entities_size < MAX_ENTITIES, "There are more than %d entities, exceeding MAX_ENTITIES", MAX_ENTITIES);
+		char *entity_type = line + entity_type_offset;
 
-	const char *entity = form_entity(grug_filename);
+		char *game_fn_names = strchr(entity_type, ' ');
+		if (!game_fn_names) {
+			continue;
+		}
+		*game_fn_names++ = '\0';
 
-	grug_assert(get_entity_index(entity) == UINT32_MAX, "The entity '%s' already exists, because there are two grug files called '%s' in the mod '%s'", entity, grug_filename, mod);
+		char *grug_path = strchr(game_fn_names, ' ');
+		if (!grug_path) {
+			continue;
+		}
+		*grug_path++ = '\0';
 
-	u32 bucket_index = elf_hash(entity) % MAX_ENTITIES;
+		if (streq(game_fn_names, "-")) {
+			*game_fn_names = '\0';
+		}
 
-	chains_entities[entities_size] = buckets_entities[bucket_index];
+		// Leaving the entry out recompiles the grug file
+		if (is_mod_api_json_changed && hash_mod_api_dependencies(entity_type, game_fn_names) != mod_api_hash) {
+			continue;
+		}
 
-	buckets_entities[bucket_index] = entities_size;
+		set_build_cache_entry(grug_path, content_hash, grug_mtime, mod_api_hash, entity_type, game_fn_names);
+	}
+	free(line);
+	grug_assert(!ferror(f), "getline error: %s", build_cache_path);
 
-	// entity_files[] needs to take ownership of `file`,
-	// since reload_modified_mod() can swap-remove the file
-	entity_files[entities_size] = *file;
+	grug_assert(fclose(f) == 0, "fclose: %s", strerror(errno));
 
-	entities[entities_size++] = entity;
+	// The new mod_api.json hash has to be saved, even if every entry was kept
+	is_build_cache_dirty = is_mod_api_json_changed;
 }
 
-static struct grug_file *push_file(struct grug_mod_dir *dir, struct grug_file file) {
-	if (dir->files_size >= dir->_files_capacity) {
-		dir->_files_capacity = dir->_files_capacity == 0 ? 1 : dir->_files_capacity * 2;
-		dir->files = realloc(dir->files, dir->_files_capacity * sizeof(*dir->files));
-		grug_assert(dir->files, "realloc: %s", strerror(errno));
+static void unsee_build_cache_entries(void) {
+	for (size_t i = 0; i < build_cache_entries_size; i++) {
+		build_cache_entries[i].seen = false;
 	}
-	dir->files[dir->files_size] = file;
-	return &dir->files[dir->files_size++];
 }
 
-static struct grug_mod_dir *push_subdir(struct grug_mod_dir *dir, struct grug_mod_dir subdir) {
-	if (dir->dirs_size >= dir->_dirs_capacity) {
-		dir->_dirs_capacity = dir->_dirs_capacity == 0 ? 1 : dir->_dirs_capacity * 2;
-		dir->dirs = realloc(dir->dirs, dir->_dirs_capacity * sizeof(*dir->dirs));
-		grug_assert(dir->dirs, "realloc: %s", strerror(errno));
+// Drops the entries of grug files that weren't seen by the last scan, since they were removed,
+// and writes the cache to a temporary file first, so a crash can't leave a half-written cache behind
+static void save_build_cache(void) {
+	size_t seen_entries_size = 0;
+	for (size_t i = 0; i < build_cache_entries_size; i++) {
+		if (build_cache_entries[i].seen) {
+			build_cache_entries[seen_entries_size++] = build_cache_entries[i];
+		} else {
+			free(build_cache_entries[i].grug_path);
+			free(build_cache_entries[i].entity_type);
+			free(build_cache_entries[i].game_fn_names);
+			is_build_cache_dirty = true;
+		}
 	}
-	dir->dirs[dir->dirs_size] = subdir;
-	return &dir->dirs[dir->dirs_size++];
-}
+	build_cache_entries_size = seen_entries_size;
+	rehash_build_cache_entries();
 
-// Profiling may indicate that rewriting this to use an O(1) technique like a hash table is worth it
-static struct grug_file *get_file(struct grug_mod_dir *dir, const char *name) {
-	for (size_t i = 0; i < dir->files_size; i++) {
-		if (streq(dir->files[i].name, name)) {
-			return dir->files + i;
-		}
+	if (!is_build_cache_dirty) {
+		return;
 	}
-	return NULL;
-}
 
-// Profiling may indicate that rewriting this to use an O(1) technique like a hash table is worth it
-static struct grug_mod_dir *get_subdir(struct grug_mod_dir *dir, const char *name) {
-	for (size_t i = 0; i < dir->dirs_size; i++) {
-		if (streq(dir->dirs[i].name, name)) {
-			return dir->dirs + i;
+	char build_cache_path[STUPID_MAX_PATH];
+	get_build_cache_path(build_cache_path);
+
+	char tmp_build_cache_path[STUPID_MAX_PATH];
+	grug_assert(snprintf(tmp_build_cache_path, sizeof(tmp_build_cache_path), "%s.%d.tmp", build_cache_path, getpid()) >= 0, "Filling the variable 'tmp_build_cache_path' failed");
+
+	try_create_parent_dirs(build_cache_path);
+
+	FILE *f = fopen(tmp_build_cache_path, "w");
+	grug_assert(f, "fopen: %s: %s", tmp_build_cache_path, strerror(errno));
+
+	fprintf(f, "grug_build_cache %u %d %016" PRIx64 "\n", BUILD_CACHE_VERSION, are_optimizations_enabled, mod_api_json_hash);
+
+	for (size_t i = 0; i < build_cache_entries_size; i++) {
+		struct build_cache_entry entry = build_cache_entries[i];
+		fprintf(f, "%016" PRIx64 " %" PRId64 " %016" PRIx64 " %s %s %s\n", entry.content_hash, entry.grug_mtime, entry.mod_api_hash, entry.entity_type, *entry.game_fn_names ? entry.game_fn_names : "-", entry.grug_path);
+	}
+
+	grug_assert(!ferror(f), "fprintf error: %s", tmp_build_cache_path);
+
+	grug_assert(fclose(f) == 0, "fclose: %s", strerror(errno));
+
+	grug_assert(rename(tmp_build_cache_path, build_cache_path) == 0, "rename: %s", strerror(errno));
+
+	is_build_cache_dirty = false;
+}
+
+// The files and subdirectories of every grug_mod_dir are hashed by name,
+// using as many buckets as the array has capacity, so the tables are rebuilt whenever the arrays grow
+static void link_child(u32 *buckets, u32 *chains, size_t capacity, const char *name, u32 index) {
+	u32 bucket_index = elf_hash(name) % capacity;
+
+	chains[index] = buckets[bucket_index];
+
+	buckets[bucket_index] = index;
+}
+
+static void unlink_child(u32 *buckets, u32 *chains, size_t capacity, const char *name, u32 index) {
+	u32 *link = &buckets[elf_hash(name) % capacity];
+	while (*link != index) {
+		link = &chains[*link];
+	}
+	*link = chains[index];
+}
+
+static void rehash_files(struct grug_mod_dir *dir) {
+	memset(dir->_files_buckets, 0xff, dir->_files_capacity * sizeof(u32));
+
+	for (size_t i = 0; i < dir->files_size; i++) {
+		link_child(dir->_files_buckets, dir->_files_chains, dir->_files_capacity, dir->files[i].name, i);
+	}
+}
+
+static void rehash_dirs(struct grug_mod_dir *dir) {
+	memset(dir->_dirs_buckets, 0xff, dir->_dirs_capacity * sizeof(u32));
+
+	for (size_t i = 0; i < dir->dirs_size; i++) {
+		link_child(dir->_dirs_buckets, dir->_dirs_chains, dir->_dirs_capacity, dir->dirs[i].name, i);
+	}
+}
+
+static struct grug_file *get_file(struct grug_mod_dir *dir, const char *name) {
+	if (dir->files_size == 0) {
+		return NULL;
+	}
+
+	u32 i = dir->_files_buckets[elf_hash(name) % dir->_files_capacity];
+
+	while (i != UINT32_MAX) {
+		if (streq(dir->files[i].name, name)) {
+			return dir->files + i;
+		}
+
+		i = dir->_files_chains[i];
+	}
+
+	return NULL;
+}
+
+static struct grug_mod_dir *get_subdir(struct grug_mod_dir *dir, const char *name) {
+	if (dir->dirs_size == 0) {
+		return NULL;
+	}
+
+	u32 i = dir->_dirs_buckets[elf_hash(name) % dir->_dirs_capacity];
+
+	while (i != UINT32_MAX) {
+		if (streq(dir->dirs[i].name, name)) {
+			return dir->dirs + i;
+		}
+
+		i = dir->_dirs_chains[i];
+	}
+
+	return NULL;
+}
+
+static struct grug_file *push_file(struct grug_mod_dir *dir, struct grug_file file) {
+	if (dir->files_size >= dir->_files_capacity) {
+		dir->_files_capacity = dir->_files_capacity == 0 ? 1 : dir->_files_capacity * 2;
+
+		dir->files = realloc(dir->files, dir->_files_capacity * sizeof(*dir->files));
+		grug_assert(dir->files, "realloc: %s", strerror(errno));
+
+		dir->_files_buckets = realloc(dir->_files_buckets, dir->_files_capacity * sizeof(u32));
+		grug_assert(dir->_files_buckets, "realloc: %s", strerror(errno));
+
+		dir->_files_chains = realloc(dir->_files_chains, dir->_files_capacity * sizeof(u32));
+		grug_assert(dir->_files_chains, "realloc: %s", strerror(errno));
+
+		rehash_files(dir);
+	}
+
+	link_child(dir->_files_buckets, dir->_files_chains, dir->_files_capacity, file.name, dir->files_size);
+
+	dir->files[dir->files_size] = file;
+	return &dir->files[dir->files_size++];
+}
+
+static struct grug_mod_dir *push_subdir(struct grug_mod_dir *dir, struct grug_mod_dir subdir) {
+	if (dir->dirs_size >= dir->_dirs_capacity) {
+		dir->_dirs_capacity = dir->_dirs_capacity == 0 ? 1 : dir->_dirs_capacity * 2;
+
+		dir->dirs = realloc(dir->dirs, dir->_dirs_capacity * sizeof(*dir->dirs));
+		grug_assert(dir->dirs, "realloc: %s", strerror(errno));
+
+		dir->_dirs_buckets = realloc(dir->_dirs_buckets, dir->_dirs_capacity * sizeof(u32));
+		grug_assert(dir->_dirs_buckets, "realloc: %s", strerror(errno));
+
+		dir->_dirs_chains = realloc(dir->_dirs_chains, dir->_dirs_capacity * sizeof(u32));
+		grug_assert(dir->_dirs_chains, "realloc: %s", strerror(errno));
+
+		rehash_dirs(dir);
+	}
+
+	link_child(dir->_dirs_buckets, dir->_dirs_chains, dir->_dirs_capacity, subdir.name, dir->dirs_size);
+
+	dir->dirs[dir->dirs_size] = subdir;
+	return &dir->dirs[dir->dirs_size++];
+}
+
+// Returns whether the dll exists
+// The loaded dll stands in for the one on disk, since it was up-to-date with the grug file its mtime back then,
+// so only the dlls of grug files that aren't loaded have to be stat()ed
+static bool get_dll_stat(const char *dll_path, struct grug_file *file, struct stat *dll_stat) {
+	if (file && file->dll) {
+		dll_stat->st_mtime = file->_grug_mtime;
+		return true;
+	}
+
+	return are_dlls_written_to_disk && stat(dll_path, dll_stat) == 0;
+}
+
+// Returns whether the grug file has to be recompiled
+// dll_stat is NULL when the dll doesn't exist
+static bool is_dll_outdated(const char *grug_path, i64 grug_file_mtime, struct stat *dll_stat) {
+	if (!dll_stat) {
+		return true;
+	}
+
+	if (!is_build_cache_used()) {
+		return grug_file_mtime > dll_stat->st_mtime;
+	}
+
+	struct build_cache_entry *entry = get_build_cache_entry(grug_path);
+	if (!entry) {
+		return true;
+	}
+
+	entry->seen = true;
+
+	if (entry->grug_mtime == grug_file_mtime) {
+		return false;
+	}
+
+	// Things like a git checkout change the mtime, without changing the content
+	if (hash_file(grug_path) != entry->content_hash) {
+		return true;
+	}
+
+	entry->grug_mtime = grug_file_mtime;
+	is_build_cache_dirty = true;
+
+	return false;
+}
+
+// Replaces the ".grug" extension of dll_entry_path with ".so",
+// or with ".optimized.so" when grug_enable_optimizations() was called,
+// so that the mtime of a dll never makes the other mode reuse it
+static void fill_dll_path(char *dll_path, const char *dll_entry_path) {
+	const char *dll_extension = are_optimizations_enabled ? ".optimized.so" : ".so";
+
+	grug_assert(strlen(dll_entry_path) - strlen(".grug") + strlen(dll_extension) + 1 <= STUPID_MAX_PATH, "There are more than %d characters in the dll path of the dll_entry_path '%s', exceeding STUPID_MAX_PATH", STUPID_MAX_PATH, dll_entry_path);
+	memcpy(dll_path, dll_entry_path, strlen(dll_entry_path) + 1);
+
+	// Cast is safe because it indexes into stack-allocated memory
+	char *extension = (char *)get_file_extension(dll_path);
+
+	// The code that called this fill_dll_path() function has already checked
+	// that the file ends with ".grug", so '.' will always be found here
+	assert(extension[0] == '.');
+
+	memcpy(extension, dll_extension, strlen(dll_extension) + 1);
+}
+
+static void push_compilation_job(const char *grug_path, const char *dll_path, const char *mod_name, u64 loaded_dll_hash) {
+	if (compilation_jobs_size >= compilation_jobs_capacity) {
+		compilation_jobs_capacity = compilation_jobs_capacity == 0 ? 1 : compilation_jobs_capacity * 2;
+		compilation_jobs = realloc(compilation_jobs, compilation_jobs_capacity * sizeof(*compilation_jobs));
+		grug_assert(compilation_jobs, "realloc: %s", strerror(errno));
+	}
+
+	struct compilation_job *job = &compilation_jobs[compilation_jobs_size++];
+	*job = (struct compilation_job){.compiled.dll_fd = -1};
+
+	job->grug_path = strdup(grug_path);
+	grug_assert(job->grug_path, "strdup: %s", strerror(errno));
+
+	job->dll_path = strdup(dll_path);
+	grug_assert(job->dll_path, "strdup: %s", strerror(errno));
+
+	job->mod = strdup(mod_name);
+	grug_assert(job->mod, "strdup: %s", strerror(errno));
+
+	job->grug_filename = strrchr(job->grug_path, '/') + 1;
+
+	job->loaded_dll_hash = loaded_dll_hash;
+}
+
+static void queue_grug_file(int dir_fd, const char *name, const char *grug_path, const char *dll_entry_path, const char *mod_name, struct grug_mod_dir *dir) {
+	struct stat grug_stat;
+	if (fstatat(dir_fd, name, &grug_stat, 0) == -1 || !S_ISREG(grug_stat.st_mode)) {
+		return;
+	}
+
+	char dll_path[STUPID_MAX_PATH];
+	fill_dll_path(dll_path, dll_entry_path);
+
+	struct grug_file *file = dir ? get_file(dir, name) : NULL;
+
+	// Unloaded grug files are only compiled once grug_get_entity_file() asks for them
+	if (is_lazy_loading_enabled && (!file || !file->dll)) {
+		return;
+	}
+
+	struct stat dll_stat;
+	bool dll_exists = get_dll_stat(dll_path, file, &dll_stat);
+
+	if (is_dll_outdated(grug_path, grug_stat.st_mtime, dll_exists ? &dll_stat : NULL)) {
+		push_compilation_job(grug_path, dll_path, mod_name, file && file->dll ? file->_dll_hash : 0);
+	}
+}
+
+// This mirrors the walk of reload_modified_mod(), but only queues the grug files whose dll is missing or outdated
+// Errors are ignored here, since reload_modified_mods() reports them in the same order as without compilation threads
+// dir is NULL when the directory hasn't been loaded yet
+static void queue_compilation_jobs_in_dir(int parent_dir_fd, const char *dir_name, const char *mods_dir_path, const char *dll_dir_path, const char *mod_name, struct grug_mod_dir *dir, size_t depth) {
+	if (depth >= MAX_DIRECTORY_DEPTH) {
+		return;
+	}
+
+	int dir_fd = openat(parent_dir_fd, dir_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dir_fd == -1) {
+		return;
+	}
+
+	// See reload_unchanged_dir()
+	struct stat dir_stat;
+	if (dir && dir->_mtime_ns != 0 && fstat(dir_fd, &dir_stat) == 0 && dir->_mtime_ns == get_mtime_ns(&dir_stat)) {
+		for (size_t i = 0; i < dir->files_size; i++) {
+			const char *name = dir->files[i].name;
+
+			char entry_path[STUPID_MAX_PATH];
+			snprintf(entry_path, sizeof(entry_path), "%s/%s", mods_dir_path, name);
+
+			char dll_entry_path[STUPID_MAX_PATH];
+			snprintf(dll_entry_path, sizeof(dll_entry_path), "%s/%s", dll_dir_path, name);
+
+			queue_grug_file(dir_fd, name, entry_path, dll_entry_path, mod_name, dir);
+		}
+
+		for (size_t i = 0; i < dir->dirs_size; i++) {
+			const char *name = dir->dirs[i].name;
+
+			char entry_path[STUPID_MAX_PATH];
+			snprintf(entry_path, sizeof(entry_path), "%s/%s", mods_dir_path, name);
+
+			char dll_entry_path[STUPID_MAX_PATH];
+			snprintf(dll_entry_path, sizeof(dll_entry_path), "%s/%s", dll_dir_path, name);
+
+			queue_compilation_jobs_in_dir(dir_fd, name, entry_path, dll_entry_path, mod_name, &dir->dirs[i], depth + 1);
+		}
+
+		close(dir_fd);
+		return;
+	}
+
+	DIR *dirp = fdopendir(dir_fd);
+	if (!dirp) {
+		close(dir_fd);
+		return;
+	}
+
+	struct dirent *dp;
+	while ((dp = readdir(dirp))) {
+		const char *name = dp->d_name;
+
+		if (streq(name, ".") || streq(name, "..")) {
+			continue;
+		}
+
+		bool is_grug_file = streq(get_file_extension(name), ".grug");
+		if (dp->d_type == DT_REG && !is_grug_file) {
+			continue;
+		}
+
+		char entry_path[STUPID_MAX_PATH];
+		snprintf(entry_path, sizeof(entry_path), "%s/%s", mods_dir_path, name);
+
+		char dll_entry_path[STUPID_MAX_PATH];
+		snprintf(dll_entry_path, sizeof(dll_entry_path), "%s/%s", dll_dir_path, name);
+
+		bool is_dir = dp->d_type == DT_DIR;
+
+		if (!is_dir && dp->d_type != DT_REG) {
+			struct stat entry_stat;
+			if (fstatat(dir_fd, name, &entry_stat, 0) == -1) {
+				continue;
+			}
+			is_dir = S_ISDIR(entry_stat.st_mode);
+		}
+
+		if (is_dir) {
+			struct grug_mod_dir *subdir = dir ? get_subdir(dir, name) : NULL;
+			queue_compilation_jobs_in_dir(dir_fd, name, entry_path, dll_entry_path, mod_name, subdir, depth + 1);
+		} else if (is_grug_file) {
+			queue_grug_file(dir_fd, name, entry_path, dll_entry_path, mod_name, dir);
+		}
+	}
+
+	closedir(dirp);
+}
+
+static void hash_compilation_jobs(void);
+
+static void queue_compilation_jobs(void) {
+	DIR *dirp = opendir(mods_root_dir_path);
+	if (!dirp) {
+		return;
+	}
+
+	struct dirent *dp;
+	while ((dp = readdir(dirp))) {
+		const char *name = dp->d_name;
+
+		if (streq(name, ".") || streq(name, "..") || dp->d_type == DT_REG) {
+			continue;
+		}
+
+		char entry_path[STUPID_MAX_PATH];
+		if (snprintf(entry_path, sizeof(entry_path), "%s/%s", mods_root_dir_path, name) < 0) {
+			continue;
+		}
+
+		char dll_entry_path[STUPID_MAX_PATH];
+		if (snprintf(dll_entry_path, sizeof(dll_entry_path), "%s/%s", dll_root_dir_path, name) < 0) {
+			continue;
+		}
+
+		// This returns right away when the entry isn't a directory
+		queue_compilation_jobs_in_dir(dirfd(dirp), name, entry_path, dll_entry_path, name, get_subdir(&grug_mods, name), 1);
+	}
+
+	closedir(dirp);
+
+	hash_compilation_jobs();
+}
+
+static void hash_compilation_jobs(void) {
+	if (compilation_jobs_size == 0) {
+		return;
+	}
+
+	buckets_compilation_jobs = realloc(buckets_compilation_jobs, compilation_jobs_size * sizeof(u32));
+	grug_assert(buckets_compilation_jobs, "realloc: %s", strerror(errno));
+
+	chains_compilation_jobs = realloc(chains_compilation_jobs, compilation_jobs_size * sizeof(u32));
+	grug_assert(chains_compilation_jobs, "realloc: %s", strerror(errno));
+
+	memset(buckets_compilation_jobs, 0xff, compilation_jobs_size * sizeof(u32));
+
+	for (size_t i = 0; i < compilation_jobs_size; i++) {
+		u32 bucket_index = elf_hash(compilation_jobs[i].grug_path) % compilation_jobs_size;
+
+		chains_compilation_jobs[i] = buckets_compilation_jobs[bucket_index];
+
+		buckets_compilation_jobs[bucket_index] = i;
+	}
+}
+
+// Returns NULL if no compilation worker thread compiled the grug file
+static struct compilation_job *get_compiled_job(const char *grug_path) {
+	if (compilation_jobs_size == 0) {
+		return NULL;
+	}
+
+	u32 i = buckets_compilation_jobs[elf_hash(grug_path) % compilation_jobs_size];
+
+	while (true) {
+		if (i == UINT32_MAX) {
+			return NULL;
+		}
+
+		if (streq(grug_path, compilation_jobs[i].grug_path)) {
+			break;
+		}
+
+		i = chains_compilation_jobs[i];
+	}
+
+	if (!compilation_jobs[i].is_compiled) {
+		return NULL;
+	}
+
+	return &compilation_jobs[i];
+}
+
+// Called by the thread that called grug_regenerate_modified_mods(),
+// in the same order as it would've called regenerate_dll()
+static void use_compiled_job(struct compilation_job *job) {
+	job->is_used = true;
+
+	if (job->error) {
+		grug_loading_error_in_grug_file = job->is_loading_error_in_grug_file;
+
+		memcpy(grug_error.msg, job->error->msg, sizeof(grug_error.msg));
+		grug_error.grug_c_line_number = job->error->grug_c_line_number;
+
+		check_if_grug_error_has_changed();
+
+		longjmp(error_jmp_buffer, 1);
+	}
+}
+
+// Frees what the compiled job holds, without loading its dll
+static void release_compiled_job(struct compilation_job *job) {
+	free(job->compiled.game_fn_names);
+	if (job->compiled.dll_fd != -1) {
+		close(job->compiled.dll_fd);
+	}
+	if (job->compiled.jit_dll) {
+		free_jit_dll(job->compiled.jit_dll);
+	}
+}
+
+// Called instead of use_compiled_job() when the grug file was modified after the job compiled it
+static void skip_compiled_job(struct compilation_job *job) {
+	job->is_used = true;
+
+	if (!job->error) {
+		release_compiled_job(job);
+	}
+}
+
+// Dlls that were compiled but never loaded, due to an earlier error, are removed,
+// so the next regenerate recompiles them and reports them in grug_reloads
+// This is also called after an error, so it must not call grug_assert()
+static void discard_compilation_jobs(void) {
+	for (size_t i = 0; i < compilation_jobs_size; i++) {
+		struct compilation_job *job = &compilation_jobs[i];
+
+		if (job->is_compiled && !job->is_used && !job->error) {
+			release_compiled_job(job);
+			if (are_dlls_written_to_disk) {
+				unlink(job->dll_path);
+			}
+		}
+
+		free(job->grug_path);
+		free(job->dll_path);
+		free(job->mod);
+		free(job->error);
+	}
+
+	compilation_jobs_size = 0;
+}
+
+// Returns false if not every array could be allocated
+static bool allocate_worker_arrays(void) {
+	#define X(name) {\
+		name = calloc(1, sizeof(name##_storage));\
+		if (!name) {\
+			return false;\
+		}\
+	}
+	WORKER_ARRAYS
+	#undef X
+
+	return true;
+}
+
+static void free_worker_arrays(void) {
+	#define X(name) {\
+		if (name != name##_storage) {\
+			free(name);\
+		}\
+	}
+	WORKER_ARRAYS
+	#undef X
+}
+
+static struct compilation_job *take_compilation_job(void) {
+	struct compilation_job *job = NULL;
+
+	mtx_lock(&compilation_jobs_mutex);
+
+	if (next_compilation_job_index < compilation_jobs_size) {
+		job = &compilation_jobs[next_compilation_job_index++];
+	}
+
+	mtx_unlock(&compilation_jobs_mutex);
+
+	return job;
+}
+
+static void run_compilation_job(struct compilation_job *job, struct grug_error *worker_error) {
+	if (setjmp(error_jmp_buffer)) {
+		// If the error can't be stored, the job is left uncompiled,
+		// so the calling thread compiles it again and runs into the same error
+		job->error = malloc(sizeof(*job->error));
+		if (job->error) {
+			*job->error = *worker_error;
+			job->is_compiled = true;
+		}
+		return;
+	}
+
+	mod = job->mod;
+
+	// This happens before the grug file is read, so a modification during the compilation gives a newer mtime
+	struct stat grug_stat;
+	grug_assert(stat(job->grug_path, &grug_stat) == 0, "stat: %s: %s", job->grug_path, strerror(errno));
+	job->grug_mtime = grug_stat.st_mtime;
+
+	initialize_file_entity_type(job->grug_filename);
+
+	if (are_dlls_written_to_disk) {
+		try_create_parent_dirs(job->dll_path);
+	}
+
+	job->is_loading_error_in_grug_file = true;
+
+	job->compiled = compile_grug_file(job->grug_path, job->dll_path, job->loaded_dll_hash, are_dlls_written_to_disk, are_dlls_in_memory, are_dlls_jitted);
+
+	job->is_loading_error_in_grug_file = false;
+
+	job->is_compiled = true;
+}
+
+static int compilation_worker(void *arg) {
+	(void)arg;
+
+	struct grug_error worker_error = {0};
+	grug_error_ptr = &worker_error;
+
+	// If the arrays can't be allocated, the calling thread compiles the remaining jobs itself
+	if (allocate_worker_arrays()) {
+		struct compilation_job *job;
+		while ((job = take_compilation_job())) {
+			run_compilation_job(job, &worker_error);
+		}
+	}
+
+	free_worker_arrays();
+
+	return 0;
+}
+
+static void run_compilation_jobs(void) {
+	size_t thread_count = compilation_thread_count;
+	if (thread_count == 0) {
+		long online_cores = sysconf(_SC_NPROCESSORS_ONLN);
+		thread_count = online_cores > 0 ? online_cores : 1;
+	}
+	if (thread_count > MAX_COMPILATION_THREADS) {
+		thread_count = MAX_COMPILATION_THREADS;
+	}
+	if (thread_count > compilation_jobs_size) {
+		thread_count = compilation_jobs_size;
+	}
+
+	// A single job is compiled faster by the calling thread, since it doesn't need to allocate any arrays
+	if (thread_count < 2) {
+		return;
+	}
+
+	grug_assert(mtx_init(&compilation_jobs_mutex, mtx_plain) == thrd_success, "mtx_init() failed");
+
+	next_compilation_job_index = 0;
+
+	// The calling thread compiles the jobs of threads that couldn't be created
+	size_t created_thread_count = 0;
+	for (; created_thread_count < thread_count; created_thread_count++) {
+		if (thrd_create(&compilation_threads[created_thread_count], compilation_worker, NULL) != thrd_success) {
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < created_thread_count; i++) {
+		thrd_join(compilation_threads[i], NULL);
+	}
+
+	mtx_destroy(&compilation_jobs_mutex);
+}
+
+static void close_dll(void *dll) {
+	if (are_dlls_jitted) {
+		free_jit_dll(dll);
+	} else if (dlclose(dll)) {
+		print_dlerror("dlclose");
+	}
+}
+
+static void retire_object(struct retired_object object) {
+	if (retired_objects_size >= retired_objects_capacity) {
+		retired_objects_capacity = retired_objects_capacity == 0 ? 1 : retired_objects_capacity * 2;
+		retired_objects = realloc(retired_objects, retired_objects_capacity * sizeof(*retired_objects));
+		grug_assert(retired_objects, "realloc: %s", strerror(errno));
+	}
+
+	object.epoch = atomic_load(&reclamation_epoch);
+
+	retired_objects[retired_objects_size++] = object;
+}
+
+// With background regeneration, reader threads can still be running on_ fns of the dll,
+// so it's only closed once every reader thread has reported a quiescent state after this
+static void release_dll(void *dll, int dll_fd) {
+	if (!is_background_regeneration_enabled) {
+		close_dll(dll);
+
+		if (dll_fd != -1) {
+			close(dll_fd);
+		}
+
+		return;
+	}
+
+	retire_object((struct retired_object){.dll = dll, .dll_fd = dll_fd});
+}
+
+static void reclaim_retired_objects(void) {
+	u64 oldest_reader_epoch = UINT64_MAX;
+
+	size_t readers_size = atomic_load(&reader_threads_size);
+	for (size_t i = 0; i < readers_size && i < MAX_READER_THREADS; i++) {
+		u64 reader_epoch = atomic_load(&reader_epochs[i]);
+		if (reader_epoch < oldest_reader_epoch) {
+			oldest_reader_epoch = reader_epoch;
+		}
+	}
+
+	// The objects are retired in order of their epoch
+	size_t reclaimable_size = 0;
+	while (reclaimable_size < retired_objects_size && retired_objects[reclaimable_size].epoch < oldest_reader_epoch) {
+		reclaimable_size++;
+	}
+
+	if (reclaimable_size == 0) {
+		return;
+	}
+
+	for (size_t i = 0; i < reclaimable_size; i++) {
+		if (retired_objects[i].dll) {
+			close_dll(retired_objects[i].dll);
+		}
+
+		if (retired_objects[i].dll_fd != -1) {
+			close(retired_objects[i].dll_fd);
+		}
+
+		free(retired_objects[i].allocation);
+	}
+
+	memmove(retired_objects, retired_objects + reclaimable_size, (retired_objects_size - reclaimable_size) * sizeof(*retired_objects));
+	retired_objects_size -= reclaimable_size;
+}
+
+// Returns whether every slot is taken
+// A slot that grug_unregister_reader_thread() released is reused
+static bool take_reader_slot(void) {
+	for (size_t i = 0; i < MAX_READER_THREADS; i++) {
+		if (!atomic_exchange(&are_reader_slots_taken[i], true)) {
+			reader_thread_index = i;
+
+			size_t size = atomic_load(&reader_threads_size);
+			while (size <= i && !atomic_compare_exchange_weak(&reader_threads_size, &size, i + 1)) {}
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool grug_report_quiescent_state(void) {
+	if (reader_thread_index == SIZE_MAX && take_reader_slot()) {
+		return true;
+	}
+
+	atomic_store(&reader_epochs[reader_thread_index], atomic_load(&reclamation_epoch));
+
+	return false;
+}
+
+void grug_unregister_reader_thread(void) {
+	if (reader_thread_index == SIZE_MAX) {
+		return;
+	}
+
+	// UINT64_MAX never holds back reclaim_retired_objects(), so the slot is ignored until it's taken again
+	atomic_store(&reader_epochs[reader_thread_index], UINT64_MAX);
+	atomic_store(&are_reader_slots_taken[reader_thread_index], false);
+
+	reader_thread_index = SIZE_MAX;
+}
+
+static u32 get_entity_index(const char *entity) {
+	if (entities_size == 0) {
+		return UINT32_MAX;
+	}
+
+	u32 i = buckets_entities[elf_hash(entity) % entities_capacity];
+
+	while (true) {
+		if (i == UINT32_MAX) {
+			return UINT32_MAX;
+		}
+
+		if (streq(entity, entities[i])) {
+			break;
+		}
+
+		i = chains_entities[i];
+	}
+
+	return i;
+}
+
+static struct grug_file *get_published_entity_file(struct published_entities *table, const char *entity) {
+	if (!table || table->size == 0) {
+		return NULL;
+	}
+
+	u32 i = table->buckets[elf_hash(entity) % table->buckets_size];
+
+	while (i != UINT32_MAX) {
+		if (streq(table->files[i]->entity, entity)) {
+			return table->files[i];
+		}
+
+		i = table->chains[i];
+	}
+
+	return NULL;
+}
+
+// The strings are stored directly after the copy, so it's freed with a single free() call
+static struct grug_file *copy_published_file(struct grug_file *file) {
+	size_t name_size = strlen(file->name) + 1;
+	size_t entity_size = strlen(file->entity) + 1;
+	size_t entity_type_size = strlen(file->entity_type) + 1;
+
+	struct grug_file *copy = malloc(sizeof(*copy) + name_size + entity_size + entity_type_size);
+	grug_assert(copy, "malloc: %s", strerror(errno));
+
+	char *name = (char *)(copy + 1);
+	char *entity = name + name_size;
+	char *entity_type = entity + entity_size;
+
+	memcpy(name, file->name, name_size);
+	memcpy(entity, file->entity, entity_size);
+	memcpy(entity_type, file->entity_type, entity_type_size);
+
+	// The other fields belong to the entity index of the calling thread
+	*copy = (struct grug_file){
+		.name = name,
+		.entity = entity,
+		.entity_type = entity_type,
+		.dll = file->dll,
+		.globals_size = file->globals_size,
+		.init_globals_fn = file->init_globals_fn,
+		.on_fns = file->on_fns,
+		._dll_fd = -1,
+		._dll_hash = file->_dll_hash,
+		._grug_mtime = file->_grug_mtime,
+	};
+
+	return copy;
+}
+
+// Replaces the published table with a new one, using a single atomic pointer swap
+// Only reloaded and added grug files get a new copy, since the dll of a copy never changes
+// The old table and the copies that the new table doesn't reuse are retired, just like the dlls they point into,
+// so this has to be called before reclamation_epoch is incremented
+static void publish_entities(void) {
+	struct published_entities *old_table = atomic_load(&published_entities);
+
+	size_t buckets_size = entities_size == 0 ? 1 : entities_size;
+
+	// The table and its arrays are a single allocation, so retiring it only takes one free() call
+	struct published_entities *table = malloc(sizeof(*table) + entities_size * sizeof(*table->files) + (buckets_size + entities_size) * sizeof(u32));
+	grug_assert(table, "malloc: %s", strerror(errno));
+
+	table->files = (struct grug_file **)(table + 1);
+	table->buckets = (u32 *)(table->files + entities_size);
+	table->chains = table->buckets + buckets_size;
+	table->size = entities_size;
+	table->buckets_size = buckets_size;
+
+	memset(table->buckets, 0xff, buckets_size * sizeof(u32));
+
+	for (size_t i = 0; i < entities_size; i++) {
+		struct grug_file *file = get_published_entity_file(old_table, entities[i]);
+
+		if (!file || file->dll != entity_files[i].dll) {
+			file = copy_published_file(&entity_files[i]);
+		}
+
+		table->files[i] = file;
+
+		u32 bucket_index = elf_hash(entities[i]) % buckets_size;
+		table->chains[i] = table->buckets[bucket_index];
+		table->buckets[bucket_index] = i;
+	}
+
+	atomic_store(&published_entities, table);
+
+	if (!old_table) {
+		return;
+	}
+
+	for (size_t i = 0; i < old_table->size; i++) {
+		struct grug_file *file = old_table->files[i];
+
+		if (get_published_entity_file(table, file->entity) != file) {
+			retire_object((struct retired_object){.allocation = file, .dll_fd = -1});
+		}
+	}
+
+	retire_object((struct retired_object){.allocation = old_table, .dll_fd = -1});
+}
+
+static void load_entity_file(struct grug_file *unloaded_file);
+
+struct grug_file *grug_get_entity_file(const char *entity) {
+	// Reader threads call this while the calling thread of grug_regenerate_modified_mods() modifies the entity index
+	if (is_background_regeneration_enabled) {
+		return get_published_entity_file(atomic_load(&published_entities), entity);
+	}
+
+	u32 index = get_entity_index(entity);
+	if (index == UINT32_MAX) {
+		return NULL;
+	}
+
+	if (!entity_files[index].dll && is_lazy_loading_enabled) {
+		if (setjmp(error_jmp_buffer)) {
+			is_entity_file_being_loaded = false;
+			return NULL;
+		}
+
+		load_entity_file(&entity_files[index]);
+	}
+
+	return &entity_files[index];
+}
+
+static void mark_entity_unchecked(const char *entity) {
+	if (unchecked_entities_size >= unchecked_entities_capacity) {
+		unchecked_entities_capacity = unchecked_entities_capacity == 0 ? 1 : unchecked_entities_capacity * 2;
+		unchecked_entities = realloc(unchecked_entities, unchecked_entities_capacity * sizeof(*unchecked_entities));
+		grug_assert(unchecked_entities, "realloc: %s", strerror(errno));
+	}
+
+	unchecked_entities[unchecked_entities_size++] = entity;
+}
+
+// Called when the grug file is freed, since check_unchecked_entities() reads the entity string
+static void forget_unchecked_entity(const char *entity) {
+	for (size_t i = unchecked_entities_size; i > 0;) {
+		i--;
+		if (unchecked_entities[i] == entity) {
+			unchecked_entities[i] = unchecked_entities[--unchecked_entities_size];
+		}
+	}
+}
+
+static void rehash_entity_dependents(void) {
+	memset(buckets_entity_dependents, 0xff, entity_dependents_capacity * sizeof(u32));
+
+	for (size_t i = 0; i < entity_dependents_size; i++) {
+		u32 bucket_index = elf_hash(entity_dependents[i].entity) % entity_dependents_capacity;
+
+		chains_entity_dependents[i] = buckets_entity_dependents[bucket_index];
+
+		buckets_entity_dependents[bucket_index] = i;
+	}
+}
+
+// Returns UINT32_MAX if no grug file depends on the entity
+static u32 get_entity_dependents_index(const char *entity) {
+	if (entity_dependents_size == 0) {
+		return UINT32_MAX;
+	}
+
+	u32 i = buckets_entity_dependents[elf_hash(entity) % entity_dependents_capacity];
+
+	while (i != UINT32_MAX) {
+		if (streq(entity, entity_dependents[i].entity)) {
+			return i;
+		}
+
+		i = chains_entity_dependents[i];
+	}
+
+	return UINT32_MAX;
+}
+
+static u32 push_entity_dependents(const char *entity) {
+	if (entity_dependents_size >= entity_dependents_capacity) {
+		entity_dependents_capacity = entity_dependents_capacity == 0 ? 1 : entity_dependents_capacity * 2;
+
+		entity_dependents = realloc(entity_dependents, entity_dependents_capacity * sizeof(*entity_dependents));
+		grug_assert(entity_dependents, "realloc: %s", strerror(errno));
+
+		buckets_entity_dependents = realloc(buckets_entity_dependents, entity_dependents_capacity * sizeof(u32));
+		grug_assert(buckets_entity_dependents, "realloc: %s", strerror(errno));
+
+		chains_entity_dependents = realloc(chains_entity_dependents, entity_dependents_capacity * sizeof(u32));
+		grug_assert(chains_entity_dependents, "realloc: %s", strerror(errno));
+
+		rehash_entity_dependents();
+	}
+
+	char *entity_copy = strdup(entity);
+	grug_assert(entity_copy, "strdup: %s", strerror(errno));
+
+	u32 i = entity_dependents_size++;
+
+	entity_dependents[i] = (struct entity_dependents){.entity = entity_copy};
+
+	u32 bucket_index = elf_hash(entity) % entity_dependents_capacity;
+	chains_entity_dependents[i] = buckets_entity_dependents[bucket_index];
+	buckets_entity_dependents[bucket_index] = i;
+
+	return i;
+}
+
+// Marks the grug files that depend on the entity, when the entity got added or removed
+static void mark_dependents_unchecked(const char *entity) {
+	u32 i = get_entity_dependents_index(entity);
+	if (i == UINT32_MAX) {
+		return;
+	}
+
+	struct entity_dependents *dependents = &entity_dependents[i];
+
+	for (size_t j = 0; j < dependents->dependents_size; j++) {
+		mark_entity_unchecked(dependents->dependents[j]);
+	}
+}
+
+static void remove_entity_dependencies(struct grug_file *file) {
+	for (size_t i = 0; i < file->_entity_dependencies_size; i++) {
+		struct entity_dependents *dependents = &entity_dependents[file->_entity_dependencies[i]];
+
+		// A grug file can depend on the same entity several times, so only one is removed
+		for (size_t j = 0; j < dependents->dependents_size; j++) {
+			if (dependents->dependents[j] == file->entity) {
+				dependents->dependents[j] = dependents->dependents[--dependents->dependents_size];
+				break;
+			}
+		}
+	}
+
+	free(file->_entity_dependencies);
+	file->_entity_dependencies = NULL;
+	file->_entity_dependency_types = NULL;
+	file->_entity_dependencies_size = 0;
+}
+
+// The entities are read from the dll once here, so checking them again doesn't need the dll
+// The entity types are borrowed from the dll, which stays open for as long as the file uses it
+static void add_entity_dependencies(struct grug_file *file, const char *dll_path) {
+	remove_entity_dependencies(file);
+
+	size_t *entities_size_ptr = get_dll_symbol(file->dll, "entities_size");
+	grug_assert(entities_size_ptr, "Retrieving the entities_size variable with get_dll_symbol() failed for %s", dll_path);
+
+	// We check for > 0, since whether malloc(0) returns NULL is implementation defined
+	if (*entities_size_ptr > 0) {
+		const char **dll_entities = get_dll_symbol(file->dll, "entities");
+		grug_assert(dll_entities, "Retrieving the entities variable with get_dll_symbol() failed for %s", dll_path);
+
+		const char **dll_entity_types = get_dll_symbol(file->dll, "entity_types");
+		grug_assert(dll_entity_types, "Retrieving the entity_types variable with get_dll_symbol() failed for %s", dll_path);
+
+		file->_entity_dependencies = malloc(*entities_size_ptr * sizeof(u32));
+		grug_assert(file->_entity_dependencies, "malloc: %s", strerror(errno));
+
+		file->_entity_dependency_types = dll_entity_types;
+
+		for (size_t i = 0; i < *entities_size_ptr; i++) {
+			u32 dependents_index = get_entity_dependents_index(dll_entities[i]);
+			if (dependents_index == UINT32_MAX) {
+				dependents_index = push_entity_dependents(dll_entities[i]);
+			}
+
+			struct entity_dependents *dependents = &entity_dependents[dependents_index];
+
+			if (dependents->dependents_size >= dependents->dependents_capacity) {
+				dependents->dependents_capacity = dependents->dependents_capacity == 0 ? 1 : dependents->dependents_capacity * 2;
+				dependents->dependents = realloc(dependents->dependents, dependents->dependents_capacity * sizeof(*dependents->dependents));
+				grug_assert(dependents->dependents, "realloc: %s", strerror(errno));
+			}
+
+			dependents->dependents[dependents->dependents_size++] = file->entity;
+
+			file->_entity_dependencies[file->_entity_dependencies_size++] = dependents_index;
+		}
+	}
+
+	mark_entity_unchecked(file->entity);
+}
+
+// Only the grug files that were reloaded, or whose dependencies were added or removed, are checked
+static void check_unchecked_entities(void) {
+	for (size_t i = 0; i < unchecked_entities_size; i++) {
+		u32 file_entity_index = get_entity_index(unchecked_entities[i]);
+
+		// A grug file that isn't in the entity index yet is checked once it is added to it
+		if (file_entity_index == UINT32_MAX || entities[file_entity_index] != unchecked_entities[i]) {
+			continue;
+		}
+
+		struct grug_file file = entity_files[file_entity_index];
+
+		for (size_t dependency_index = 0; dependency_index < file._entity_dependencies_size; dependency_index++) {
+			const char *entity = entity_dependents[file._entity_dependencies[dependency_index]].entity;
+
+			u32 entity_index = get_entity_index(entity);
+
+			grug_assert(entity_index != UINT32_MAX, "The entity '%s' does not exist", entity);
+
+			const char *json_entity_type = file._entity_dependency_types[dependency_index];
+
+			struct grug_file other_file = entity_files[entity_index];
+
+			grug_assert(*json_entity_type == '\0' || streq(other_file.entity_type, json_entity_type), "The entity '%s' has the type '%s', whereas the expected type from mod_api.json is '%s'", entity, other_file.entity_type, json_entity_type);
+		}
+	}
+
+	unchecked_entities_size = 0;
+}
+
+static void push_reload(const char *grug_path, void *old_dll, struct grug_file file) {
+	if (grug_reloads_size >= grug_reloads_capacity) {
+		grug_reloads_capacity = grug_reloads_capacity == 0 ? 1 : grug_reloads_capacity * 2;
+		grug_reloads = realloc(grug_reloads, grug_reloads_capacity * sizeof(*grug_reloads));
+		grug_assert(grug_reloads, "realloc: %s", strerror(errno));
+	}
+
+	const char *path = strdup(grug_path);
+	grug_assert(path, "strdup: %s", strerror(errno));
+
+	grug_reloads[grug_reloads_size++] = (struct grug_modified){
+		.path = path,
+		.old_dll = old_dll,
+		.file = file,
+	};
+}
+
+// Returns `mod + ':' + grug_filename - "-<entity type>.grug"`
+static const char *form_entity(const char *grug_filename) {
+	static char entity_name[MAX_ENTITY_NAME_LENGTH];
+
+	const char *dash = strrchr(grug_filename, '-');
+	if (dash == NULL) {
+		// The function initialize_file_entity_type() already checked for a missing dash
+		grug_unreachable();
+	}
+
+	size_t entity_name_length = dash - grug_filename;
+
+	grug_assert(entity_name_length < MAX_ENTITY_NAME_LENGTH, "There are more than %d entity name characters in the grug filename '%s', exceeding MAX_ENTITY_NAME_LENGTH", MAX_ENTITY_NAME_LENGTH, grug_filename);
+	memcpy(entity_name, grug_filename, entity_name_length);
+	entity_name[entity_name_length] = '\0';
+
+	static char entity[MAX_ENTITY_NAME_LENGTH];
+	grug_assert(snprintf(entity, sizeof(entity), "%s:%s", mod, entity_name) >= 0, "Filling the variable 'entity' failed");
+
+	return entity;
+}
+
+static void link_entity(u32 index) {
+	u32 bucket_index = elf_hash(entities[index]) % entities_capacity;
+
+	chains_entities[index] = buckets_entities[bucket_index];
+
+	buckets_entities[bucket_index] = index;
+}
+
+static void rehash_entities(void) {
+	memset(buckets_entities, 0xff, entities_capacity * sizeof(u32));
+
+	for (size_t i = 0; i < entities_size; i++) {
+		link_entity(i);
+	}
+}
+
+static void push_entity(struct grug_file *file) {
+	if (entities_size >= entities_capacity) {
+		entities_capacity = entities_capacity == 0 ? 1 : entities_capacity * 2;
+
+		entities = realloc(entities, entities_capacity * sizeof(*entities));
+		grug_assert(entities, "realloc: %s", strerror(errno));
+
+		buckets_entities = realloc(buckets_entities, entities_capacity * sizeof(u32));
+		grug_assert(buckets_entities, "realloc: %s", strerror(errno));
+
+		chains_entities = realloc(chains_entities, entities_capacity * sizeof(u32));
+		grug_assert(chains_entities, "realloc: %s", strerror(errno));
+
+		entity_files = realloc(entity_files, entities_capacity * sizeof(*entity_files));
+		grug_assert(entity_files, "realloc: %s", strerror(errno));
+
+		rehash_entities();
+	}
+
+	// entity_files[] needs to take ownership of `file`,
+	// since reload_modified_mod() can swap-remove the file
+	entity_files[entities_size] = *file;
+
+	entities[entities_size] = file->entity;
+
+	link_entity(entities_size++);
+
+	mark_entity_unchecked(file->entity);
+	mark_dependents_unchecked(file->entity);
+}
+
+// The entity index borrows file->entity, so the file has to be removed from the index before it is freed
+static void add_entity(struct grug_file *file) {
+	u32 entity_index = get_entity_index(file->entity);
+
+	// The pointer is compared, since the index holds on to the file across regenerate calls
+	if (entity_index != UINT32_MAX && entities[entity_index] == file->entity) {
+		entity_files[entity_index] = *file;
+		return;
+	}
+
+	if (entity_index == UINT32_MAX) {
+		push_entity(file);
+		return;
+	}
+
+	// Only the pointer is compared when the file is freed, so a file can't be pending twice
+	for (size_t i = 0; i < pending_entity_files_size; i++) {
+		if (pending_entity_files[i].entity == file->entity) {
+			pending_entity_files[i] = *file;
+			return;
+		}
+	}
+
+	if (pending_entity_files_size >= pending_entity_files_capacity) {
+		pending_entity_files_capacity = pending_entity_files_capacity == 0 ? 1 : pending_entity_files_capacity * 2;
+		pending_entity_files = realloc(pending_entity_files, pending_entity_files_capacity * sizeof(*pending_entity_files));
+		grug_assert(pending_entity_files, "realloc: %s", strerror(errno));
+	}
+
+	pending_entity_files[pending_entity_files_size++] = *file;
+}
+
+// Called once the walk is done, when grug files that were removed have also been removed from the entity index
+static void add_pending_entities(void) {
+	for (size_t i = 0; i < pending_entity_files_size; i++) {
+		struct grug_file *file = &pending_entity_files[i];
+
+		const char *colon = strchr(file->entity, ':');
+		assert(colon);
+
+		grug_assert(get_entity_index(file->entity) == UINT32_MAX, "The entity '%s' already exists, because there are two grug files called '%s' in the mod '%.*s'", file->entity, file->name, (int)(colon - file->entity), file->entity);
+
+		push_entity(file);
+	}
+
+	pending_entity_files_size = 0;
+}
+
+static void unlink_entity(u32 index) {
+	u32 *link = &buckets_entities[elf_hash(entities[index]) % entities_capacity];
+	while (*link != index) {
+		link = &chains_entities[*link];
+	}
+	*link = chains_entities[index];
+}
+
+// Swap-removes the entity, if it is in the index
+// The pointer is compared, since a different grug file with the same entity name may have replaced it
+static void remove_entity(const char *entity) {
+	for (size_t i = 0; i < pending_entity_files_size; i++) {
+		if (pending_entity_files[i].entity == entity) {
+			pending_entity_files[i] = pending_entity_files[--pending_entity_files_size];
+			return;
+		}
+	}
+
+	u32 index = get_entity_index(entity);
+	if (index == UINT32_MAX || entities[index] != entity) {
+		return;
+	}
+
+	unlink_entity(index);
+
+	u32 last_index = entities_size - 1;
+	if (index != last_index) {
+		unlink_entity(last_index);
+
+		entities[index] = entities[last_index];
+		entity_files[index] = entity_files[last_index];
+
+		link_entity(index);
+	}
+
+	entities_size--;
+	mark_dependents_unchecked(entity);
+}
+
+static void free_file(struct grug_file file) {
+	remove_entity(file.entity);
+	remove_entity_dependencies(&file);
+	forget_unchecked_entity(file.entity);
+
+	free((void *)file.name);
+	free((void *)file.entity);
+	free((void *)file.entity_type);
+	free((void *)file._grug_path);
+
+	if (file.dll) {
+		release_dll(file.dll, file._dll_fd);
+	} else if (file._dll_fd != -1) {
+		close(file._dll_fd);
+	}
+
+	unindex_resources(file._resources, file._resources_size);
+	free(file._resources);
+}
+
+static const char *dup_about_string(const char *str) {
+	char *copy = strdup(str);
+	grug_assert(copy, "strdup: %s", strerror(errno));
+	return copy;
+}
+
+static void free_about(struct grug_mod_about about) {
+	free((void *)about.name);
+	free((void *)about.version);
+	free((void *)about.game_version);
+	free((void *)about.author);
+
+	for (size_t i = 0; i < about.extra_fields_size; i++) {
+		free((void *)about.extra_fields[i].key);
+		free((void *)about.extra_fields[i].value);
+	}
+	free(about.extra_fields);
+}
+
+static void free_dir(struct grug_mod_dir dir) {
+	free((void *)dir.name);
+
+	free_about(dir.about);
+
+	for (size_t i = 0; i < dir.dirs_size; i++) {
+		free_dir(dir.dirs[i]);
+	}
+	free(dir.dirs);
+
+	for (size_t i = 0; i < dir.files_size; i++) {
+		free_file(dir.files[i]);
+	}
+	free(dir.files);
+
+	free(dir._dirs_buckets);
+	free(dir._dirs_chains);
+	free(dir._files_buckets);
+	free(dir._files_chains);
+}
+
+// Frees and swap-removes the file, keeping the hashed index of the directory up to date
+static void remove_file(struct grug_mod_dir *dir, size_t index) {
+	size_t last_index = dir->files_size - 1;
+
+	unlink_child(dir->_files_buckets, dir->_files_chains, dir->_files_capacity, dir->files[index].name, index);
+	if (index != last_index) {
+		unlink_child(dir->_files_buckets, dir->_files_chains, dir->_files_capacity, dir->files[last_index].name, last_index);
+	}
+
+	free_file(dir->files[index]);
+
+	if (index != last_index) {
+		dir->files[index] = dir->files[last_index];
+		link_child(dir->_files_buckets, dir->_files_chains, dir->_files_capacity, dir->files[index].name, index);
+	}
+
+	dir->files_size--;
+}
+
+// Frees and swap-removes the subdirectory, keeping the hashed index of the directory up to date
+static void remove_subdir(struct grug_mod_dir *dir, size_t index) {
+	size_t last_index = dir->dirs_size - 1;
+
+	unlink_child(dir->_dirs_buckets, dir->_dirs_chains, dir->_dirs_capacity, dir->dirs[index].name, index);
+	if (index != last_index) {
+		unlink_child(dir->_dirs_buckets, dir->_dirs_chains, dir->_dirs_capacity, dir->dirs[last_index].name, last_index);
+	}
+
+	free_dir(dir->dirs[index]);
+
+	if (index != last_index) {
+		dir->dirs[index] = dir->dirs[last_index];
+		link_child(dir->_dirs_buckets, dir->_dirs_chains, dir->_dirs_capacity, dir->dirs[index].name, index);
+	}
+
+	dir->dirs_size--;
+}
+
+// The dll is opened from dll_path, unless compiled holds a memfd or a JITted dll
+static struct grug_file *regenerate_file(struct grug_file *file, const char *dll_path, struct compiled_grug_file compiled, const char *grug_filename, struct grug_mod_dir *dir) {
+	int dll_fd = compiled.dll_fd;
+
+	struct grug_file new_file = {._dll_fd = dll_fd, ._dll_hash = compiled.dll_hash};
+
+	if (compiled.jit_dll) {
+		new_file.dll = compiled.jit_dll;
+	} else if (dll_fd == -1) {
+		new_file.dll = dlopen(dll_path, RTLD_NOW);
+	} else {
+		// The memfd has to stay open for as long as the dll is,
+		// since dlopen() would otherwise return the old dll when a new memfd reuses the same fd number
+		char memfd_path[STUPID_MAX_PATH];
+		grug_assert(snprintf(memfd_path, sizeof(memfd_path), "/proc/self/fd/%d", dll_fd) >= 0, "Filling the variable 'memfd_path' failed");
+
+		new_file.dll = dlopen(memfd_path, RTLD_NOW);
+	}
+	if (!new_file.dll) {
+		if (dll_fd != -1) {
+			close(dll_fd);
+		}
+		print_dlerror("dlopen");
+	}
+
+	size_t *globals_size_ptr = get_dll_symbol(new_file.dll, "globals_size");
+	grug_assert(globals_size_ptr, "Retrieving the globals_size variable with get_dll_symbol() failed for %s", dll_path);
+	new_file.globals_size = *globals_size_ptr;
+
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wpedantic"
+	new_file.init_globals_fn = get_dll_symbol(new_file.dll, "init_globals");
+	#pragma GCC diagnostic pop
+	grug_assert(new_file.init_globals_fn, "Retrieving the init_globals() function with get_dll_symbol() failed for %s", dll_path);
+
+	// on_fns is optional, so don't check for NULL
+	// Note that if an entity in mod_api.json specifies that it has on_fns that the modder can use,
+	// on_fns is guaranteed NOT to be NULL!
+	new_file.on_fns = get_dll_symbol(new_file.dll, "on_fns");
+
+	size_t *resources_size_ptr = get_dll_symbol(new_file.dll, "resources_size");
+	size_t dll_resources_size = *resources_size_ptr;
+
+	if (file) {
+		file->dll = new_file.dll;
+		file->_dll_fd = new_file._dll_fd;
+		file->_dll_hash = new_file._dll_hash;
+		file->globals_size = new_file.globals_size;
+		file->init_globals_fn = new_file.init_globals_fn;
+		file->on_fns = new_file.on_fns;
+	} else {
+		new_file.name = strdup(grug_filename);
+		grug_assert(new_file.name, "strdup: %s", strerror(errno));
+
+		new_file.entity = strdup(form_entity(grug_filename));
+		grug_assert(new_file.entity, "strdup: %s", strerror(errno));
+
+		new_file.entity_type = strdup(file_entity_type);
+		grug_assert(new_file.entity_type, "strdup: %s", strerror(errno));
+
+		file = push_file(dir, new_file);
+	}
+
+	// The resource paths are copied into the resource index once here,
+	// so checking whether the resources were modified doesn't need the dll
+	u32 *old_resources = file->_resources;
+	size_t old_resources_size = file->_resources_size;
+
+	file->_resources = NULL;
+	file->_resources_size = 0;
+
+	// We check dll_resources_size > 0, since whether malloc(0) returns NULL is implementation defined
+	// See https://stackoverflow.com/a/1073175/13279557
+	if (dll_resources_size > 0) {
+		const char **dll_resources = get_dll_symbol(file->dll, "resources");
+		grug_assert(dll_resources, "Retrieving resources with get_dll_symbol() failed for %s", dll_path);
+
+		file->_resources = malloc(dll_resources_size * sizeof(u32));
+		grug_assert(file->_resources, "malloc: %s", strerror(errno));
+
+		for (size_t i = 0; i < dll_resources_size; i++) {
+			file->_resources[i] = index_resource(dll_resources[i]);
+			file->_resources_size++;
+		}
+	}
+
+	// This happens after the new resources were indexed,
+	// so the resources that both versions reference keep their mtime
+	unindex_resources(old_resources, old_resources_size);
+	free(old_resources);
+
+	add_entity_dependencies(file, dll_path);
+
+	// The copy in the entity index would otherwise keep pointing at the freed dependencies,
+	// if an error happens before reload_grug_file() updates it
+	u32 entity_index = get_entity_index(file->entity);
+	if (entity_index != UINT32_MAX && entities[entity_index] == file->entity) {
+		entity_files[entity_index] = *file;
+	}
+
+	return file;
+}
+
+// The grug file is only added to the entity index, so it's compiled and loaded by the first grug_get_entity_file() call
+static void add_unloaded_file(struct grug_file *file, const char *grug_filename, struct grug_mod_dir *dir, const char *grug_path) {
+	if (!file) {
+		struct grug_file new_file = {._dll_fd = -1};
+
+		new_file.name = strdup(grug_filename);
+		grug_assert(new_file.name, "strdup: %s", strerror(errno));
+
+		new_file.entity = strdup(form_entity(grug_filename));
+		grug_assert(new_file.entity, "strdup: %s", strerror(errno));
+
+		new_file.entity_type = strdup(file_entity_type);
+		grug_assert(new_file.entity_type, "strdup: %s", strerror(errno));
+
+		new_file._grug_path = strdup(grug_path);
+		grug_assert(new_file._grug_path, "strdup: %s", strerror(errno));
+
+		file = push_file(dir, new_file);
+	}
+
+	file->_seen = true;
+
+	add_entity(file);
+}
+
+static void reload_grug_file(const char *dll_entry_path, i64 grug_file_mtime, const char *grug_filename, struct grug_mod_dir *dir, const char *grug_path) {
+	initialize_file_entity_type(grug_filename);
+
+	struct grug_file *file = get_file(dir, grug_filename);
+
+	if (is_lazy_loading_enabled && !is_entity_file_being_loaded && (!file || !file->dll)) {
+		add_unloaded_file(file, grug_filename, dir, grug_path);
+		return;
+	}
+
+	char dll_path[STUPID_MAX_PATH];
+	fill_dll_path(dll_path, dll_entry_path);
+
+	struct stat dll_stat;
+	bool dll_exists = get_dll_stat(dll_path, file, &dll_stat);
+
+	bool needs_regeneration = is_dll_outdated(grug_path, grug_file_mtime, dll_exists ? &dll_stat : NULL);
+
+	if (needs_regeneration && are_dlls_written_to_disk) {
+		// If the dll doesn't exist, try to create the parent directories
+		errno = 0;
+		if (access(dll_path, F_OK) && errno == ENOENT) {
+			try_create_parent_dirs(dll_path);
+			errno = 0;
+		}
+		grug_assert(errno == 0 || errno == ENOENT, "access: %s", strerror(errno));
+	}
+
+	// A compilation worker thread may have already regenerated the dll, see run_compilation_jobs()
+	struct compilation_job *job = get_compiled_job(grug_path);
+	if (job) {
+		needs_regeneration = true;
+
+		// The grug file was modified after the job compiled it, so its dll is outdated,
+		// even though the dll on disk can be newer than the grug file
+		if (job->grug_mtime != grug_file_mtime) {
+			skip_compiled_job(job);
+			job = NULL;
+		}
+	}
+
+	// The calling thread never waits for the compiler with background regeneration, so the old dll stays loaded
+	if (needs_regeneration && !job && is_background_regeneration_enabled) {
+		are_grug_files_deferred = true;
+
+		if (!file) {
+			is_new_grug_file_deferred = true;
+			return;
+		}
+	} else if (needs_regeneration || !file || !file->dll) {
+		void *old_dll = NULL;
+
+		set_grug_error_path(grug_path);
+
+		struct compiled_grug_file compiled = {.dll_fd = -1};
+
+		if (needs_regeneration) {
+			if (job) {
+				use_compiled_job(job);
+				compiled = job->compiled;
+			} else {
+				compiled = regenerate_dll(grug_path, dll_path, file && file->dll ? file->_dll_hash : 0, are_dlls_written_to_disk, are_dlls_in_memory, are_dlls_jitted);
+			}
+
+			if (is_build_cache_used()) {
+				set_build_cache_entry(grug_path, compiled.content_hash, grug_file_mtime, compiled.mod_api_hash, file_entity_type, compiled.game_fn_names);
+			}
+
+			free(compiled.game_fn_names);
+		}
+
+		if (compiled.is_dll_unchanged) {
+			// The loaded dll is kept, since it's identical to the dll that was just generated
+			file->_grug_mtime = grug_file_mtime;
+		} else {
+			if (file && file->dll) {
+				old_dll = file->dll;
+
+				// This dlclose() needs to happen after the regenerate_dll() call,
+				// since even if regenerate_dll() throws when a typo is introduced to a mod,
+				// we want to keep the pre-typo DLL version open so the game doesn't crash
+				//
+				// This dlclose() needs to happen before the upcoming dlopen() call,
+				// since the DLL won't be reloaded otherwise
+				// Background regeneration defers it, which is why it opens every dll from a new memfd
+				release_dll(file->dll, file->_dll_fd);
+
+				// Not necessary, but makes debugging less confusing
+				file->dll = NULL;
+				file->_dll_fd = -1;
+			}
+
+			file = regenerate_file(file, dll_path, compiled, grug_filename, dir);
+
+			file->_grug_mtime = grug_file_mtime;
+
+			// Let the game developer know that a grug file was recompiled
+			// Loading a grug file for the first time isn't a reload, since the game didn't have the old version
+			if (needs_regeneration && !is_entity_file_being_loaded) {
+				push_reload(grug_path, old_dll, *file);
+			}
+		}
+	}
+
+	file->_seen = true;
+
+	// Needed for grug_get_entitity_file() and check_unchecked_entities()
+	add_entity(file);
+
+	reload_resources(file);
+}
+
+static void reload_modified_mod(int dir_fd, const char *mods_dir_path, const char *dll_dir_path, struct grug_mod_dir *dir);
+
+static void reload_subdir(int dir_fd, const char *name, const char *entry_path, const char *dll_entry_path, struct grug_mod_dir *subdir) {
+	int subdir_fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	grug_assert(subdir_fd != -1, "open(\"%s\"): %s", entry_path, strerror(errno));
+
+	reload_modified_mod(subdir_fd, entry_path, dll_entry_path, subdir);
+}
+
+static void reload_entry(int dir_fd, const struct dirent *dp, const char *mods_dir_path, const char *dll_dir_path, struct grug_mod_dir *dir) {
+	const char *name = dp->d_name;
+
+	if (streq(name, ".") || streq(name, "..")) {
+		return;
+	}
+
+	// Other files, like about.json and resources, don't need to be stat()ed when readdir() knows they're regular files
+	bool is_grug_file = streq(get_file_extension(name), ".grug");
+	if (dp->d_type == DT_REG && !is_grug_file) {
+		return;
+	}
+
+	char entry_path[STUPID_MAX_PATH];
+	snprintf(entry_path, sizeof(entry_path), "%s/%s", mods_dir_path, name);
+
+	char dll_entry_path[STUPID_MAX_PATH];
+	snprintf(dll_entry_path, sizeof(dll_entry_path), "%s/%s", dll_dir_path, name);
+
+	struct stat entry_stat;
+	bool is_dir = dp->d_type == DT_DIR;
+
+	if (!is_dir) {
+		grug_assert(fstatat(dir_fd, name, &entry_stat, 0) == 0, "stat: %s: %s", entry_path, strerror(errno));
+		is_dir = S_ISDIR(entry_stat.st_mode);
+	}
+
+	if (is_dir) {
+		struct grug_mod_dir *subdir = get_subdir(dir, name);
+
+		if (!subdir) {
+			struct grug_mod_dir inserted_subdir = {.name = strdup(name)};
+			grug_assert(inserted_subdir.name, "strdup: %s", strerror(errno));
+			subdir = push_subdir(dir, inserted_subdir);
+		}
+
+		subdir->_seen = true;
+
+		reload_subdir(dir_fd, name, entry_path, dll_entry_path, subdir);
+	} else if (S_ISREG(entry_stat.st_mode) && is_grug_file) {
+		reload_grug_file(dll_entry_path, entry_stat.st_mtime, name, dir, entry_path);
+	}
+}
+
+// inotify_add_watch() returns the existing watch descriptor when the directory is already watched,
+// so this is safe to call on every scan, and automatically picks up newly created directories
+static void watch_dir(const char *dir_path) {
+	if (inotify_fd == -1) {
+		return;
+	}
+
+	grug_assert(inotify_add_watch(inotify_fd, dir_path, INOTIFY_WATCH_MASK) != -1, "inotify_add_watch(\"%s\"): %s", dir_path, strerror(errno));
+}
+
+// Returns the mtime of the directory that a later scan can trust, or 0 if the directory has to be read again
+// Filesystems use coarse timestamps, so an entry that's created right after the directory was read can leave its mtime untouched,
+// which is why an mtime is only trusted once it's at least MIN_TRUSTED_DIR_MTIME_AGE_NS old
+static i64 get_trusted_dir_mtime_ns(struct stat *dir_stat) {
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	i64 now_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+	i64 dir_mtime_ns = get_mtime_ns(dir_stat);
+
+	if (now_ns - dir_mtime_ns < MIN_TRUSTED_DIR_MTIME_AGE_NS) {
+		return 0;
+	}
+	return dir_mtime_ns;
+}
+
+// Adding, removing or renaming an entry changes the mtime of its directory,
+// so a directory with the same mtime as during its last scan has the same entries,
+// and only its grug files need to be stat()ed, to see whether they were modified
+static void reload_unchanged_dir(int dir_fd, const char *mods_dir_path, const char *dll_dir_path, struct grug_mod_dir *dir) {
+	for (size_t i = 0; i < dir->files_size; i++) {
+		const char *name = dir->files[i].name;
+
+		char entry_path[STUPID_MAX_PATH];
+		snprintf(entry_path, sizeof(entry_path), "%s/%s", mods_dir_path, name);
+
+		char dll_entry_path[STUPID_MAX_PATH];
+		snprintf(dll_entry_path, sizeof(dll_entry_path), "%s/%s", dll_dir_path, name);
+
+		struct stat entry_stat;
+		grug_assert(fstatat(dir_fd, name, &entry_stat, 0) == 0, "stat: %s: %s", entry_path, strerror(errno));
+
+		reload_grug_file(dll_entry_path, entry_stat.st_mtime, name, dir, entry_path);
+	}
+
+	for (size_t i = 0; i < dir->dirs_size; i++) {
+		const char *name = dir->dirs[i].name;
+
+		char entry_path[STUPID_MAX_PATH];
+		snprintf(entry_path, sizeof(entry_path), "%s/%s", mods_dir_path, name);
+
+		char dll_entry_path[STUPID_MAX_PATH];
+		snprintf(dll_entry_path, sizeof(dll_entry_path), "%s/%s", dll_dir_path, name);
+
+		reload_subdir(dir_fd, name, entry_path, dll_entry_path, &dir->dirs[i]);
+	}
+}
+
+static void reload_changed_dir(int dir_fd, const char *mods_dir_path, const char *dll_dir_path, struct grug_mod_dir *dir) {
+	DIR *dirp = fdopendir(dir_fd);
+	grug_assert(dirp, "opendir(\"%s\"): %s", mods_dir_path, strerror(errno));
+
+	for (size_t i = 0; i < dir->dirs_size; i++) {
+		dir->dirs[i]._seen = false;
+	}
+	for (size_t i = 0; i < dir->files_size; i++) {
+		dir->files[i]._seen = false;
+	}
+
+	errno = 0;
+	struct dirent *dp;
+	while ((dp = readdir(dirp))) {
+		reload_entry(dir_fd, dp, mods_dir_path, dll_dir_path, dir);
+	}
+	grug_assert(errno == 0, "readdir: %s", strerror(errno));
+
+	closedir(dirp);
+
+	// If the directory used to contain a subdirectory or file
+	// that doesn't exist anymore, free it
+	for (size_t i = dir->dirs_size; i > 0;) {
+		i--;
+		if (!dir->dirs[i]._seen) {
+			remove_subdir(dir, i);
+		}
+	}
+	for (size_t i = dir->files_size; i > 0;) {
+		i--;
+		if (!dir->files[i]._seen) {
+			remove_file(dir, i);
+		}
+	}
+}
+
+// This closes dir_fd
+static void reload_modified_mod(int dir_fd, const char *mods_dir_path, const char *dll_dir_path, struct grug_mod_dir *dir) {
+	directory_depth++;
+	grug_assert(directory_depth < MAX_DIRECTORY_DEPTH, "There is a mod that contains more than %d levels of nested directories", MAX_DIRECTORY_DEPTH);
+
+	// This has to happen before the directory is read, so that entries created during the readdir() loop
+	// are either seen by it, or cause an event that makes the next call rescan
+	watch_dir(mods_dir_path);
+
+	// This has to happen before the directory is read, for the same reason
+	struct stat dir_stat;
+	grug_assert(fstat(dir_fd, &dir_stat) == 0, "stat: %s: %s", mods_dir_path, strerror(errno));
+
+	if (dir->_mtime_ns != 0 && dir->_mtime_ns == get_mtime_ns(&dir_stat)) {
+		reload_unchanged_dir(dir_fd, mods_dir_path, dll_dir_path, dir);
+		close(dir_fd);
+	} else {
+		bool was_new_grug_file_deferred = is_new_grug_file_deferred;
+		is_new_grug_file_deferred = false;
+
+		// An error longjmps out of reload_changed_dir(), leaving the mtime at 0, so the next scan reads the directory again
+		dir->_mtime_ns = 0;
+		reload_changed_dir(dir_fd, mods_dir_path, dll_dir_path, dir);
+		dir->_mtime_ns = is_new_grug_file_deferred ? 0 : get_trusted_dir_mtime_ns(&dir_stat);
+
+		is_new_grug_file_deferred = was_new_grug_file_deferred;
+	}
+
+	assert(directory_depth > 0);
+	directory_depth--;
+}
+
+// The about.json file is only parsed and validated again when it was modified since the last call,
+// so regenerating the mods doesn't have to parse the about.json file of every mod every time
+static void load_about_file(const char *about_json_path, struct grug_mod_dir *dir) {
+	struct stat about_stat;
+	if (stat(about_json_path, &about_stat) == -1) {
+		grug_assert(errno != ENOENT, "Every mod requires an 'about.json' file, but the mod '%s' doesn't have one", mod);
+		grug_error("stat: %s: %s", about_json_path, strerror(errno));
+	}
+
+	int64_t about_mtime_ns = get_mtime_ns(&about_stat);
+
+	if (dir->about.name && dir->_about_mtime_ns == about_mtime_ns && dir->_about_size == about_stat.st_size) {
+		return;
+	}
+
+	struct json_node node;
+	json(about_json_path, &node);
+
+	grug_assert(node.type == JSON_NODE_OBJECT, "%s its root must be an object", about_json_path);
+	struct json_object root_object = node.object;
+
+	grug_assert(root_object.field_count >= 4, "%s must have at least these 4 fields, in this order: \"name\", \"version\", \"game_version\", \"author\"", about_json_path);
+
+	struct json_field *field = root_object.fields;
+
+	grug_assert(streq(field->key, "name"), "%s its root object must have \"name\" as its first field", about_json_path);
+	grug_assert(field->value->type == JSON_NODE_STRING, "%s its \"name\" field must have a string as its value", about_json_path);
+	grug_assert(!streq(field->value->string, ""), "%s its \"name\" field value must not be an empty string", about_json_path);
+	field++;
+
+	grug_assert(streq(field->key, "version"), "%s its root object must have \"version\" as its second field", about_json_path);
+	grug_assert(field->value->type == JSON_NODE_STRING, "%s its \"version\" field must have a string as its value", about_json_path);
+	grug_assert(!streq(field->value->string, ""), "%s its \"version\" field value must not be an empty string", about_json_path);
+	field++;
+
+	grug_assert(streq(field->key, "game_version"), "%s its root object must have \"game_version\" as its third field", about_json_path);
+	grug_assert(field->value->type == JSON_NODE_STRING, "%s its \"game_version\" field must have a string as its value", about_json_path);
+	grug_assert(!streq(field->value->string, ""), "%s its \"game_version\" field value must not be an empty string", about_json_path);
+	field++;
+
+	grug_assert(streq(field->key, "author"), "%s its root object must have \"author\" as its fourth field", about_json_path);
+	grug_assert(field->value->type == JSON_NODE_STRING, "%s its \"author\" field must have a string as its value", about_json_path);
+	grug_assert(!streq(field->value->string, ""), "%s its \"author\" field value must not be an empty string", about_json_path);
+	field++;
+
+	for (size_t i = 4; i < root_object.field_count; i++) {
+		grug_assert(!streq(field->key, ""), "%s its %zuth field key must not be an empty string", about_json_path, i + 1);
+		field++;
+	}
+
+	struct grug_mod_about about = {
+		.name = dup_about_string(root_object.fields[0].value->string),
+		.version = dup_about_string(root_object.fields[1].value->string),
+		.game_version = dup_about_string(root_object.fields[2].value->string),
+		.author = dup_about_string(root_object.fields[3].value->string),
+		.extra_fields_size = root_object.field_count - 4,
+	};
+
+	if (about.extra_fields_size > 0) {
+		about.extra_fields = malloc(about.extra_fields_size * sizeof(*about.extra_fields));
+		grug_assert(about.extra_fields, "malloc: %s", strerror(errno));
+
+		for (size_t i = 0; i < about.extra_fields_size; i++) {
+			struct json_field *extra_field = &root_object.fields[4 + i];
+
+			about.extra_fields[i].key = dup_about_string(extra_field->key);
+			about.extra_fields[i].value = extra_field->value->type == JSON_NODE_STRING ? dup_about_string(extra_field->value->string) : NULL;
 		}
 	}
-	return NULL;
+
+	free_about(dir->about);
+	dir->about = about;
+	dir->_about_mtime_ns = about_mtime_ns;
+	dir->_about_size = about_stat.st_size;
 }
 
-static struct grug_file *regenerate_file(struct grug_file *file, const char *dll_path, const char *grug_filename, struct grug_mod_dir *dir) {
-	struct grug_file new_file = {0};
+const struct grug_mod_about *grug_get_mod_about(const char *mod_name) {
+	struct grug_mod_dir *dir = get_subdir(&grug_mods, mod_name);
+	if (!dir || !dir->about.name) {
+		return NULL;
+	}
+	return &dir->about;
+}
 
-	new_file.dll = dlopen(dll_path, RTLD_NOW);
-	if (!new_file.dll) {
-		print_dlerror("dlopen");
+// Cases:
+// 1. "" => ""
+// 2. "/" => ""
+// 3. "/a" => "a"
+// 4. "/a/" => ""
+// 5. "/a/b" => "b"
+static const char *get_basename(const char *path) {
+	const char *base = strrchr(path, '/');
+	return base ? base + 1 : path;
+}
+
+static void reload_modified_mods(void) {
+	struct grug_mod_dir *dir = &grug_mods;
+
+	watch_dir(mods_root_dir_path);
+
+	DIR *dirp = opendir(mods_root_dir_path);
+	grug_assert(dirp, "opendir(\"%s\"): %s", mods_root_dir_path, strerror(errno));
+
+	int dir_fd = dirfd(dirp);
+
+	for (size_t i = 0; i < dir->dirs_size; i++) {
+		dir->dirs[i]._seen = false;
 	}
 
-	size_t *globals_size_ptr = get_dll_symbol(new_file.dll, "globals_size");
-	grug_assert(globals_size_ptr, "Retrieving the globals_size variable with get_dll_symbol() failed for %s", dll_path);
-	new_file.globals_size = *globals_size_ptr;
+	errno = 0;
+	struct dirent *dp;
+	while ((dp = readdir(dirp))) {
+		const char *name = dp->d_name;
 
-	#pragma GCC diagnostic push
-	#pragma GCC diagnostic ignored "-Wpedantic"
-	new_file.init_globals_fn = get_dll_symbol(new_file.dll, "init_globals");
-	#pragma GCC diagnostic pop
-	grug_assert(new_file.init_globals_fn, "Retrieving the init_globals() function with get_dll_symbol() failed for %s", dll_path);
+		if (streq(name, ".") || streq(name, "..") || dp->d_type == DT_REG) {
+			continue;
+		}
 
-	// on_fns is optional, so don't check for NULL
-	// Note that if an entity in mod_api.json specifies that it has on_fns that the modder can use,
-	// on_fns is guaranteed NOT to be NULL!
-	new_file.on_fns = get_dll_symbol(new_file.dll, "on_fns");
+		static char entry_path[STUPID_MAX_PATH];
+		grug_assert(snprintf(entry_path, sizeof(entry_path), "%s/%s", mods_root_dir_path, name) >= 0, "Filling the variable 'entry_path' failed");
 
-	size_t *resources_size_ptr = get_dll_symbol(new_file.dll, "resources_size");
-	size_t dll_resources_size = *resources_size_ptr;
+		bool is_dir = dp->d_type == DT_DIR;
 
-	if (file) {
-		file->dll = new_file.dll;
-		file->globals_size = new_file.globals_size;
-		file->init_globals_fn = new_file.init_globals_fn;
-		file->on_fns = new_file.on_fns;
+		if (!is_dir) {
+			struct stat entry_stat;
+			grug_assert(fstatat(dir_fd, name, &entry_stat, 0) == 0, "stat: %s: %s", entry_path, strerror(errno));
+			is_dir = S_ISDIR(entry_stat.st_mode);
+		}
+
+		if (is_dir) {
+			mod = name;
+
+			static char about_json_path[STUPID_MAX_PATH];
+			grug_assert(snprintf(about_json_path, sizeof(about_json_path), "%s/about.json", entry_path) >= 0, "Filling the variable 'about_json_path' failed");
+
+			static char dll_entry_path[STUPID_MAX_PATH];
+			grug_assert(snprintf(dll_entry_path, sizeof(dll_entry_path), "%s/%s", dll_root_dir_path, name) >= 0, "Filling the variable 'dll_entry_path' failed");
+
+			// This always returns NULL during the first call of reload_modified_mods()
+			struct grug_mod_dir *subdir = get_subdir(dir, name);
+
+			if (!subdir) {
+				struct grug_mod_dir inserted_subdir = {.name = strdup(name)};
+				grug_assert(inserted_subdir.name, "strdup: %s", strerror(errno));
+				subdir = push_subdir(dir, inserted_subdir);
+			}
+
+			load_about_file(about_json_path, subdir);
+
+			subdir->_seen = true;
+
+			reload_subdir(dir_fd, name, entry_path, dll_entry_path, subdir);
+			assert(directory_depth == 0);
+		}
+	}
+	grug_assert(errno == 0, "readdir: %s", strerror(errno));
+
+	closedir(dirp);
+
+	// If the directory used to contain a mod that doesn't exist anymore, free it
+	for (size_t i = dir->dirs_size; i > 0;) {
+		i--;
+		if (!dir->dirs[i]._seen) {
+			remove_subdir(dir, i);
+		}
+	}
+}
+
+bool grug_init(grug_runtime_error_handler_t handler, const char *mod_api_json_path, const char *mods_dir_path, const char *dll_dir_path, uint64_t on_fn_time_limit_ms_) {
+	if (setjmp(error_jmp_buffer)) {
+		return true;
+	}
+
+	assert(handler && "grug_init() its grug_runtime_error_handler can't be NULL");
+	grug_runtime_error_handler = handler;
+
+	assert(!is_grug_initialized && "grug_init() can't be called more than once");
+
+	assert(!strchr(mods_dir_path, '\\') && "grug_init() its mods_dir_path can't contain backslashes, so replace them with '/'");
+	assert(mods_dir_path[strlen(mods_dir_path) - 1] != '/' && "grug_init() its mods_dir_path can't have a trailing '/'");
+
+	assert(!strchr(dll_dir_path, '\\') && "grug_init() its dll_dir_path can't contain backslashes, so replace them with '/'");
+	assert(dll_dir_path[strlen(dll_dir_path) - 1] != '/' && "grug_init() its dll_dir_path can't have a trailing '/'");
+
+	parse_mod_api_json(mod_api_json_path);
+
+	mod_api_json_hash = hash_file(mod_api_json_path);
+
+	assert(strlen(mods_dir_path) + 1 <= STUPID_MAX_PATH && "grug_init() its mods_dir_path exceeds the maximum path length");
+	memcpy(mods_root_dir_path, mods_dir_path, strlen(mods_dir_path) + 1);
+
+	assert(strlen(dll_dir_path) + 1 <= STUPID_MAX_PATH && "grug_init() its dll_dir_path exceeds the maximum path length");
+	memcpy(dll_root_dir_path, dll_dir_path, strlen(dll_dir_path) + 1);
+
+	on_fn_time_limit_ms = on_fn_time_limit_ms_;
+	on_fn_time_limit_sec = on_fn_time_limit_ms / MS_PER_SEC;
+	on_fn_time_limit_ns = (on_fn_time_limit_ms % MS_PER_SEC) * NS_PER_MS;
+
+	is_grug_initialized = true;
+
+	return false;
+}
+
+// Any event dirties the mods, since the full scan finds out what changed anyway
+// An IN_Q_OVERFLOW event means events were dropped, which also just dirties the mods
+static void read_inotify_events(void) {
+	// The alignment is required by inotify(7)
+	char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	while (true) {
+		ssize_t events_size = read(inotify_fd, events, sizeof(events));
+
+		if (events_size == -1) {
+			grug_assert(errno == EAGAIN, "read: %s", strerror(errno));
+			break;
+		}
+
+		if (events_size > 0) {
+			are_mods_dirty = true;
+		}
+	}
+}
+
+bool grug_enable_inotify(void) {
+	assert(is_grug_initialized && "You forgot to call grug_init() once at program startup!");
+
+	if (setjmp(error_jmp_buffer)) {
+		return true;
+	}
+
+	if (inotify_fd != -1) {
+		return false;
+	}
+
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	grug_assert(inotify_fd != -1, "inotify_init1: %s", strerror(errno));
+
+	// The directories only get watched during the next scan
+	are_mods_dirty = true;
+
+	return false;
+}
+
+// Returns whether inotify reported that nothing changed since the last regeneration,
+// in which case the previous grug_mods tree and entity index are still correct
+static bool are_mods_unchanged(void) {
+	if (inotify_fd == -1) {
+		return false;
+	}
+
+	read_inotify_events();
+
+	return !are_mods_dirty;
+}
+
+// The regenerate_modified_mods functions leave the grug_mods tree untouched before this
+static void prepare_regeneration(void) {
+	grug_loading_error_in_grug_file = false;
+
+	if (is_build_cache_used()) {
+		if (!is_build_cache_loaded) {
+			load_build_cache();
+		}
+		unsee_build_cache_entries();
+	}
+
+	if (are_dlls_jitted) {
+		resolve_jit_game_fn_addresses();
+	}
+}
+
+// Loads the compiled jobs, and compiles whatever grug files the jobs didn't cover, unless background regeneration is enabled
+static void finish_regeneration(void) {
+	reset_reloads();
+
+	are_grug_files_deferred = false;
+
+	// This is what grug_regenerate_mod() and grug_regenerate_file() check,
+	// so it's only done once a regeneration actually walks the mods directory
+	if (!grug_mods.name) {
+		grug_mods.name = strdup(get_basename(mods_root_dir_path));
+		grug_assert(grug_mods.name, "strdup: %s", strerror(errno));
+	}
+
+	reload_modified_mods();
+
+	add_pending_entities();
+
+	check_unchecked_entities();
+
+	discard_compilation_jobs();
+
+	if (is_build_cache_used()) {
+		save_build_cache();
+	}
+
+	reset_previous_grug_error();
+
+	are_mods_dirty = are_grug_files_deferred;
+}
+
+// Drops the jobs of an unfinished grug_regenerate_modified_mods_step() regeneration
+static void abandon_regeneration_steps(void) {
+	if (is_regeneration_step_pending) {
+		discard_compilation_jobs();
+		is_regeneration_step_pending = false;
+	}
+}
+
+static void set_background_state(enum background_state state) {
+	mtx_lock(&background_mutex);
+	background_state = state;
+	cnd_broadcast(&background_cnd);
+	mtx_unlock(&background_mutex);
+}
+
+static enum background_state get_background_state(void) {
+	mtx_lock(&background_mutex);
+	enum background_state state = background_state;
+	mtx_unlock(&background_mutex);
+	return state;
+}
+
+// run_compilation_jobs() leaves the jobs to the calling thread when it can't create threads
+static void compile_remaining_jobs(struct grug_error *background_error) {
+	for (size_t i = 0; i < compilation_jobs_size; i++) {
+		if (!compilation_jobs[i].is_compiled) {
+			run_compilation_job(&compilation_jobs[i], background_error);
+		}
+	}
+}
+
+static int background_regeneration_thread(void *arg) {
+	(void)arg;
+
+	struct grug_error background_error = {0};
+	grug_error_ptr = &background_error;
+
+	if (!allocate_worker_arrays()) {
+		free_worker_arrays();
+		set_background_state(BACKGROUND_FAILED);
+		return 0;
+	}
+
+	set_background_state(BACKGROUND_IDLE);
+
+	while (true) {
+		mtx_lock(&background_mutex);
+		while (background_state != BACKGROUND_COMPILING) {
+			cnd_wait(&background_cnd, &background_mutex);
+		}
+		mtx_unlock(&background_mutex);
 
-		if (dll_resources_size > 0) {
-			file->_resource_mtimes = realloc(file->_resource_mtimes, dll_resources_size * sizeof(i64));
-			grug_assert(file->_resource_mtimes, "realloc: %s", strerror(errno));
+		if (setjmp(error_jmp_buffer)) {
+			// The calling thread compiles the grug files itself when the jobs couldn't be queued
+			discard_compilation_jobs();
 		} else {
-			// We can't use realloc() to do this
-			// See https://stackoverflow.com/a/16760080/13279557
-			free(file->_resource_mtimes);
-			file->_resource_mtimes = NULL;
+			queue_compilation_jobs();
+			run_compilation_jobs();
+			compile_remaining_jobs(&background_error);
 		}
-	} else {
-		new_file.name = strdup(grug_filename);
-		grug_assert(new_file.name, "strdup: %s", strerror(errno));
 
-		new_file.entity = strdup(form_entity(grug_filename));
-		grug_assert(new_file.entity, "strdup: %s", strerror(errno));
+		set_background_state(BACKGROUND_COMPILED);
+	}
 
-		new_file.entity_type = strdup(file_entity_type);
-		grug_assert(new_file.entity_type, "strdup: %s", strerror(errno));
+	return 0;
+}
+
+// Never waits for the background thread to finish compiling
+static void regenerate_in_background(void) {
+	clear_reloads();
+
+	enum background_state state = get_background_state();
+
+	if (state == BACKGROUND_COMPILED) {
+		// The grug files that were modified after the background thread scanned them are left to its next scan
+		finish_regeneration();
+
+		// A regeneration that fails leaves the reader threads on the table of the last one that succeeded
+		publish_entities();
+
+		set_background_state(BACKGROUND_IDLE);
+		state = BACKGROUND_IDLE;
+
+		// The reader threads that report a quiescent state after this can't be using the replaced dlls and table anymore
+		atomic_fetch_add(&reclamation_epoch, 1);
+	}
+
+	reclaim_retired_objects();
+
+	if (state != BACKGROUND_IDLE || are_mods_unchanged()) {
+		return;
+	}
+
+	prepare_regeneration();
+
+	set_background_state(BACKGROUND_COMPILING);
+}
+
+bool grug_enable_background_regeneration(void) {
+	assert(is_grug_initialized && "You forgot to call grug_init() once at program startup!");
+	assert(!grug_mods.name && "grug_enable_background_regeneration() has to be called before the first grug_regenerate_modified_mods() call");
+
+	if (setjmp(error_jmp_buffer)) {
+		return true;
+	}
+
+	if (is_background_regeneration_enabled) {
+		return false;
+	}
+
+	assert(!is_lazy_loading_enabled && "grug_enable_background_regeneration() can't be used together with grug_enable_lazy_loading()");
+
+	// dlopen() returns the old dll for as long as it's open, when it's given the same path
+	if (!are_dlls_jitted) {
+		are_dlls_in_memory = true;
+	}
+
+	grug_assert(mtx_init(&background_mutex, mtx_plain) == thrd_success, "mtx_init() failed");
+	grug_assert(cnd_init(&background_cnd) == thrd_success, "cnd_init() failed");
 
-		// We check dll_resources_size > 0, since whether malloc(0) returns NULL is implementation defined
-		// See https://stackoverflow.com/a/1073175/13279557
-		if (dll_resources_size > 0) {
-			new_file._resource_mtimes = malloc(dll_resources_size * sizeof(i64));
-			grug_assert(new_file._resource_mtimes, "malloc: %s", strerror(errno));
+	thrd_t background_thread;
+	grug_assert(thrd_create(&background_thread, background_regeneration_thread, NULL) == thrd_success, "thrd_create() failed");
+
+	mtx_lock(&background_mutex);
+	while (background_state == BACKGROUND_STARTING) {
+		cnd_wait(&background_cnd, &background_mutex);
+	}
+	mtx_unlock(&background_mutex);
+
+	if (background_state == BACKGROUND_FAILED) {
+		thrd_join(background_thread, NULL);
+		grug_error("Allocating the arrays of the background regeneration thread failed");
+	}
+
+	thrd_detach(background_thread);
+
+	is_background_regeneration_enabled = true;
+
+	return false;
+}
+
+bool grug_regenerate_modified_mods(void) {
+	assert(is_grug_initialized && "You forgot to call grug_init() once at program startup!");
+
+	if (setjmp(error_jmp_buffer)) {
+		if (!is_background_regeneration_enabled) {
+			discard_compilation_jobs();
+		} else if (get_background_state() == BACKGROUND_COMPILED) {
+			// The jobs are only discarded when the background thread is done with them
+			discard_compilation_jobs();
+			set_background_state(BACKGROUND_IDLE);
 		}
 
-		file = push_file(dir, new_file);
+		return true;
+	}
+
+	if (is_background_regeneration_enabled) {
+		regenerate_in_background();
+		return false;
 	}
 
-	if (dll_resources_size > 0) {
-		const char **dll_resources = get_dll_symbol(file->dll, "resources");
+	abandon_regeneration_steps();
 
-		// Initialize file->_resource_mtimes
-		for (size_t i = 0; i < dll_resources_size; i++) {
-			struct stat resource_stat;
-			grug_assert(stat(dll_resources[i], &resource_stat) == 0, "%s: %s", dll_resources[i], strerror(errno));
+	if (are_mods_unchanged()) {
+		clear_reloads();
+		return false;
+	}
 
-			file->_resource_mtimes[i] = resource_stat.st_mtime;
-		}
+	prepare_regeneration();
+
+	if (compilation_thread_count != 1) {
+		queue_compilation_jobs();
+		run_compilation_jobs();
 	}
 
-	return file;
+	finish_regeneration();
+
+	return false;
 }
 
-static void reload_grug_file(const char *dll_entry_path, i64 grug_file_mtime, const char *grug_filename, struct grug_mod_dir *dir, const char *grug_path) {
-	initialize_file_entity_type(grug_filename);
+static u64 get_monotonic_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
 
-	// Fill dll_path
-	char dll_path[STUPID_MAX_PATH];
-	grug_assert(strlen(dll_entry_path) + 1 <= STUPID_MAX_PATH, "There are more than %d characters in the dll_entry_path '%s', exceeding STUPID_MAX_PATH", STUPID_MAX_PATH, dll_entry_path);
-	memcpy(dll_path, dll_entry_path, strlen(dll_entry_path) + 1);
+bool grug_regenerate_modified_mods_step(uint64_t budget_ns, bool *is_done) {
+	assert(is_grug_initialized && "You forgot to call grug_init() once at program startup!");
+	assert(!is_background_regeneration_enabled && "grug_regenerate_modified_mods_step() can't be used together with grug_enable_background_regeneration()");
 
-	// Cast is safe because it indexes into stack-allocated memory
-	char *extension = (char *)get_file_extension(dll_path);
+	u64 start_ns = get_monotonic_ns();
 
-	// The code that called this reload_grug_file() function has already checked
-	// that the file ends with ".grug", so '.' will always be found here
-	assert(extension[0] == '.');
+	*is_done = true;
 
-	// We know that there's enough space, since ".so" is shorter than ".grug"
-	memcpy(extension + 1, "so", sizeof("so"));
+	if (setjmp(error_jmp_buffer)) {
+		discard_compilation_jobs();
+		is_regeneration_step_pending = false;
+		return true;
+	}
 
-	struct stat dll_stat;
-	bool dll_exists = stat(dll_path, &dll_stat) == 0;
+	// The reloads of the previous step were already handled by the game
+	clear_reloads();
 
-	if (!dll_exists) {
-		// If the dll doesn't exist, try to create the parent directories
-		errno = 0;
-		if (access(dll_path, F_OK) && errno == ENOENT) {
-			try_create_parent_dirs(dll_path);
-			errno = 0;
+	if (!is_regeneration_step_pending) {
+		if (are_mods_unchanged()) {
+			return false;
 		}
-		grug_assert(errno == 0 || errno == ENOENT, "access: %s", strerror(errno));
-	}
 
-	// If the dll doesn't exist or is outdated
-	bool needs_regeneration = !dll_exists || grug_file_mtime > dll_stat.st_mtime;
+		prepare_regeneration();
 
-	struct grug_file *file = get_file(dir, grug_filename);
+		queue_compilation_jobs();
 
-	if (needs_regeneration || !file) {
-		struct grug_modified modified = {0};
+		is_regeneration_step_pending = true;
+		next_compilation_job_index = 0;
+	}
 
-		set_grug_error_path(grug_path);
+	// At least one grug file is compiled per step, so a tiny budget still makes progress
+	// Compilation errors are stored in the job, and reported by the step that loads it
+	while (next_compilation_job_index < compilation_jobs_size) {
+		grug_error_ptr = &step_compilation_error;
+		run_compilation_job(&compilation_jobs[next_compilation_job_index++], &step_compilation_error);
+		grug_error_ptr = &grug_error;
 
-		if (needs_regeneration) {
-			regenerate_dll(grug_path, dll_path);
+		if (get_monotonic_ns() - start_ns >= budget_ns) {
+			break;
 		}
+	}
 
-		if (file && file->dll) {
-			modified.old_dll = file->dll;
+	// run_compilation_job() overwrote error_jmp_buffer
+	if (setjmp(error_jmp_buffer)) {
+		discard_compilation_jobs();
+		is_regeneration_step_pending = false;
+		return true;
+	}
 
-			// This dlclose() needs to happen after the regenerate_dll() call,
-			// since even if regenerate_dll() throws when a typo is introduced to a mod,
-			// we want to keep the pre-typo DLL version open so the game doesn't crash
-			//
-			// This dlclose() needs to happen before the upcoming dlopen() call,
-			// since the DLL won't be reloaded otherwise
-			if (dlclose(file->dll)) {
-				print_dlerror("dlclose");
-			}
+	if (next_compilation_job_index < compilation_jobs_size) {
+		*is_done = false;
+		return false;
+	}
 
-			// Not necessary, but makes debugging less confusing
-			file->dll = NULL;
-		}
+	is_regeneration_step_pending = false;
 
-		file = regenerate_file(file, dll_path, grug_filename, dir);
+	finish_regeneration();
 
-		// Let the game developer know that a grug file was recompiled
-		if (needs_regeneration) {
-			// Since modified.path is the maximum path length of operating systems,
-			// it shouldn't be possible for grug_path to exceed it
-			assert(strlen(grug_path) + 1 <= sizeof(modified.path));
+	return false;
+}
 
-			memcpy(modified.path, grug_path, strlen(grug_path) + 1);
+// Shared by grug_regenerate_mod() and grug_regenerate_file()
+static void prepare_targeted_regeneration(void) {
+	assert(!is_background_regeneration_enabled && "grug_regenerate_mod() and grug_regenerate_file() can't be used together with grug_enable_background_regeneration()");
 
-			modified.file = *file;
-			push_reload(modified);
-		}
-	}
+	abandon_regeneration_steps();
 
-	file->_seen = true;
+	reset_reloads();
+
+	grug_loading_error_in_grug_file = false;
 
-	// Needed for grug_get_entitity_file() and check_that_every_entity_exists()
-	add_entity(grug_filename, file);
+	if (is_build_cache_used() && !is_build_cache_loaded) {
+		load_build_cache();
+	}
 
-	// Let the game developer know when they need to reload a resource
-	if (file->_resources_size > 0) {
-		reload_resources_from_dll(dll_path, file->_resource_mtimes, file->_resources_size);
+	if (are_dlls_jitted) {
+		resolve_jit_game_fn_addresses();
 	}
 }
 
-static void reload_modified_mod(const char *mods_dir_path, const char *dll_dir_path, struct grug_mod_dir *dir);
+// Shared by grug_regenerate_mod() and grug_regenerate_file()
+static void finish_targeted_regeneration(void) {
+	add_pending_entities();
 
-static void reload_entry(const char *name, const char *mods_dir_path, const char *dll_dir_path, struct grug_mod_dir *dir) {
-	if (streq(name, ".") || streq(name, "..")) {
-		return;
+	check_unchecked_entities();
+
+	discard_compilation_jobs();
+
+	if (is_build_cache_used()) {
+		save_build_cache();
 	}
 
-	char entry_path[STUPID_MAX_PATH];
-	snprintf(entry_path, sizeof(entry_path), "%s/%s", mods_dir_path, name);
+	reset_previous_grug_error();
+}
+
+// Compiles and loads the grug file of an entity that lazy loading only added to the entity index
+// Unlike grug_regenerate_file(), this leaves grug_reloads untouched, since the game can be iterating over it
+static void load_entity_file(struct grug_file *unloaded_file) {
+	assert(!is_background_regeneration_enabled);
+
+	grug_loading_error_in_grug_file = false;
+
+	const char *grug_path = unloaded_file->_grug_path;
+
+	size_t mods_root_dir_path_length = strlen(mods_root_dir_path);
+
+	// This copy gets cut up into the mod name, the subdirectory names, and the grug filename
+	char relative_path[STUPID_MAX_PATH];
+	grug_assert(snprintf(relative_path, sizeof(relative_path), "%s", grug_path + mods_root_dir_path_length + 1) >= 0, "Filling the variable 'relative_path' failed");
 
 	char dll_entry_path[STUPID_MAX_PATH];
-	snprintf(dll_entry_path, sizeof(dll_entry_path), "%s/%s", dll_dir_path, name);
+	grug_assert(snprintf(dll_entry_path, sizeof(dll_entry_path), "%s/%s", dll_root_dir_path, relative_path) >= 0, "Filling the variable 'dll_entry_path' failed");
 
-	struct stat entry_stat;
-	grug_assert(stat(entry_path, &entry_stat) == 0, "stat: %s: %s", entry_path, strerror(errno));
+	struct stat grug_stat;
+	grug_assert(stat(grug_path, &grug_stat) == 0, "stat: %s: %s", grug_path, strerror(errno));
 
-	if (S_ISDIR(entry_stat.st_mode)) {
-		struct grug_mod_dir *subdir = get_subdir(dir, name);
+	char *slash = strchr(relative_path, '/');
+	assert(slash);
+	*slash = '\0';
 
-		if (!subdir) {
-			struct grug_mod_dir inserted_subdir = {.name = strdup(name)};
-			grug_assert(inserted_subdir.name, "strdup: %s", strerror(errno));
-			subdir = push_subdir(dir, inserted_subdir);
-		}
+	mod = relative_path;
 
-		subdir->_seen = true;
+	struct grug_mod_dir *dir = get_subdir(&grug_mods, relative_path);
 
-		reload_modified_mod(entry_path, dll_entry_path, subdir);
-	} else if (S_ISREG(entry_stat.st_mode) && streq(get_file_extension(name), ".grug")) {
-		reload_grug_file(dll_entry_path, entry_stat.st_mtime, name, dir, entry_path);
+	char *dir_name = slash + 1;
+
+	// Walks down to the directory that contains the grug file
+	for (char *next_slash; (next_slash = strchr(dir_name, '/')); dir_name = next_slash + 1) {
+		*next_slash = '\0';
+		dir = get_subdir(dir, dir_name);
 	}
-}
 
-static void reload_modified_mod(const char *mods_dir_path, const char *dll_dir_path, struct grug_mod_dir *dir) {
-	directory_depth++;
-	grug_assert(directory_depth < MAX_DIRECTORY_DEPTH, "There is a mod that contains more than %d levels of nested directories", MAX_DIRECTORY_DEPTH);
+	const char *grug_filename = dir_name;
 
-	DIR *dirp = opendir(mods_dir_path);
-	grug_assert(dirp, "opendir(\"%s\"): %s", mods_dir_path, strerror(errno));
+	// The entity index only contains grug files that are in the grug_mods tree
+	assert(dir && get_file(dir, grug_filename));
 
-	for (size_t i = 0; i < dir->dirs_size; i++) {
-		dir->dirs[i]._seen = false;
-	}
-	for (size_t i = 0; i < dir->files_size; i++) {
-		dir->files[i]._seen = false;
+	if (are_dlls_jitted) {
+		resolve_jit_game_fn_addresses();
 	}
 
-	errno = 0;
-	struct dirent *dp;
-	while ((dp = readdir(dirp))) {
-		reload_entry(dp->d_name, mods_dir_path, dll_dir_path, dir);
-	}
-	grug_assert(errno == 0, "readdir: %s", strerror(errno));
+	is_entity_file_being_loaded = true;
+	reload_grug_file(dll_entry_path, grug_stat.st_mtime, grug_filename, dir, grug_path);
+	is_entity_file_being_loaded = false;
 
-	closedir(dirp);
+	check_unchecked_entities();
 
-	// If the directory used to contain a subdirectory or file
-	// that doesn't exist anymore, free it
-	for (size_t i = dir->dirs_size; i > 0;) {
-		i--;
-		if (!dir->dirs[i]._seen) {
-			free_dir(dir->dirs[i]);
-			dir->dirs[i] = dir->dirs[--dir->dirs_size]; // Swap-remove
-		}
-	}
-	for (size_t i = dir->files_size; i > 0;) {
-		i--;
-		if (!dir->files[i]._seen) {
-			free_file(dir->files[i]);
-			dir->files[i] = dir->files[--dir->files_size]; // Swap-remove
-		}
+	if (is_build_cache_used()) {
+		save_build_cache();
 	}
 
-	assert(directory_depth > 0);
-	directory_depth--;
+	reset_previous_grug_error();
 }
 
-static void validate_about_file(const char *about_json_path) {
-	grug_assert(access(about_json_path, F_OK) == 0, "Every mod requires an 'about.json' file, but the mod '%s' doesn't have one", mod);
+bool grug_regenerate_mod(const char *mod_name) {
+	assert(is_grug_initialized && "You forgot to call grug_init() once at program startup!");
+	assert(grug_mods.name && "grug_regenerate_mod() requires grug_regenerate_modified_mods() to have been called at least once");
+	assert(!strchr(mod_name, '/') && "grug_regenerate_mod() its mod_name can't contain a '/'");
 
-	struct json_node node;
-	json(about_json_path, &node);
+	if (setjmp(error_jmp_buffer)) {
+		discard_compilation_jobs();
+		return true;
+	}
 
-	grug_assert(node.type == JSON_NODE_OBJECT, "%s its root must be an object", about_json_path);
-	struct json_object root_object = node.object;
+	prepare_targeted_regeneration();
 
-	grug_assert(root_object.field_count >= 4, "%s must have at least these 4 fields, in this order: \"name\", \"version\", \"game_version\", \"author\"", about_json_path);
+	char mod_path[STUPID_MAX_PATH];
+	grug_assert(snprintf(mod_path, sizeof(mod_path), "%s/%s", mods_root_dir_path, mod_name) >= 0, "Filling the variable 'mod_path' failed");
 
-	struct json_field *field = root_object.fields;
+	char dll_mod_path[STUPID_MAX_PATH];
+	grug_assert(snprintf(dll_mod_path, sizeof(dll_mod_path), "%s/%s", dll_root_dir_path, mod_name) >= 0, "Filling the variable 'dll_mod_path' failed");
 
-	grug_assert(streq(field->key, "name"), "%s its root object must have \"name\" as its first field", about_json_path);
-	grug_assert(field->value->type == JSON_NODE_STRING, "%s its \"name\" field must have a string as its value", about_json_path);
-	grug_assert(!streq(field->value->string, ""), "%s its \"name\" field value must not be an empty string", about_json_path);
-	field++;
+	struct grug_mod_dir *dir = get_subdir(&grug_mods, mod_name);
 
-	grug_assert(streq(field->key, "version"), "%s its root object must have \"version\" as its second field", about_json_path);
-	grug_assert(field->value->type == JSON_NODE_STRING, "%s its \"version\" field must have a string as its value", about_json_path);
-	grug_assert(!streq(field->value->string, ""), "%s its \"version\" field value must not be an empty string", about_json_path);
-	field++;
+	struct stat mod_stat;
+	errno = 0;
+	if (stat(mod_path, &mod_stat) == -1 || !S_ISDIR(mod_stat.st_mode)) {
+		grug_assert(errno == 0 || errno == ENOENT, "stat: %s: %s", mod_path, strerror(errno));
 
-	grug_assert(streq(field->key, "game_version"), "%s its root object must have \"game_version\" as its third field", about_json_path);
-	grug_assert(field->value->type == JSON_NODE_STRING, "%s its \"game_version\" field must have a string as its value", about_json_path);
-	grug_assert(!streq(field->value->string, ""), "%s its \"game_version\" field value must not be an empty string", about_json_path);
-	field++;
+		// The mod was removed
+		if (dir) {
+			remove_subdir(&grug_mods, dir - grug_mods.dirs);
+		}
+	} else {
+		mod = mod_name;
 
-	grug_assert(streq(field->key, "author"), "%s its root object must have \"author\" as its fourth field", about_json_path);
-	grug_assert(field->value->type == JSON_NODE_STRING, "%s its \"author\" field must have a string as its value", about_json_path);
-	grug_assert(!streq(field->value->string, ""), "%s its \"author\" field value must not be an empty string", about_json_path);
-	field++;
+		char about_json_path[STUPID_MAX_PATH];
+		grug_assert(snprintf(about_json_path, sizeof(about_json_path), "%s/about.json", mod_path) >= 0, "Filling the variable 'about_json_path' failed");
 
-	for (size_t i = 4; i < root_object.field_count; i++) {
-		grug_assert(!streq(field->key, ""), "%s its %zuth field key must not be an empty string", about_json_path, i + 1);
-		field++;
-	}
-}
+		if (!dir) {
+			struct grug_mod_dir inserted_dir = {.name = strdup(mod_name)};
+			grug_assert(inserted_dir.name, "strdup: %s", strerror(errno));
+			dir = push_subdir(&grug_mods, inserted_dir);
+		}
 
-// Cases:
-// 1. "" => ""
-// 2. "/" => ""
-// 3. "/a" => "a"
-// 4. "/a/" => ""
-// 5. "/a/b" => "b"
-static const char *get_basename(const char *path) {
-	const char *base = strrchr(path, '/');
-	return base ? base + 1 : path;
-}
+		load_about_file(about_json_path, dir);
 
-static void reload_modified_mods(void) {
-	struct grug_mod_dir *dir = &grug_mods;
+		dir->_seen = true;
 
-	DIR *dirp = opendir(mods_root_dir_path);
-	grug_assert(dirp, "opendir(\"%s\"): %s", mods_root_dir_path, strerror(errno));
+		if (compilation_thread_count != 1) {
+			queue_compilation_jobs_in_dir(AT_FDCWD, mod_path, mod_path, dll_mod_path, mod_name, dir, 1);
+			hash_compilation_jobs();
+			run_compilation_jobs();
+		}
 
-	for (size_t i = 0; i < dir->dirs_size; i++) {
-		dir->dirs[i]._seen = false;
+		reload_subdir(AT_FDCWD, mod_path, mod_path, dll_mod_path, dir);
+		assert(directory_depth == 0);
 	}
 
-	errno = 0;
-	struct dirent *dp;
-	while ((dp = readdir(dirp))) {
-		const char *name = dp->d_name;
+	finish_targeted_regeneration();
 
-		if (streq(name, ".") || streq(name, "..")) {
-			continue;
-		}
+	return false;
+}
 
-		static char entry_path[STUPID_MAX_PATH];
-		grug_assert(snprintf(entry_path, sizeof(entry_path), "%s/%s", mods_root_dir_path, name) >= 0, "Filling the variable 'entry_path' failed");
+bool grug_regenerate_file(const char *grug_path) {
+	assert(is_grug_initialized && "You forgot to call grug_init() once at program startup!");
+	assert(grug_mods.name && "grug_regenerate_file() requires grug_regenerate_modified_mods() to have been called at least once");
 
-		struct stat entry_stat;
-		grug_assert(stat(entry_path, &entry_stat) == 0, "stat: %s: %s", entry_path, strerror(errno));
+	if (setjmp(error_jmp_buffer)) {
+		return true;
+	}
 
-		if (S_ISDIR(entry_stat.st_mode)) {
-			mod = name;
+	prepare_targeted_regeneration();
 
-			static char about_json_path[STUPID_MAX_PATH];
-			grug_assert(snprintf(about_json_path, sizeof(about_json_path), "%s/about.json", entry_path) >= 0, "Filling the variable 'about_json_path' failed");
+	size_t mods_root_dir_path_length = strlen(mods_root_dir_path);
+	grug_assert(strncmp(grug_path, mods_root_dir_path, mods_root_dir_path_length) == 0 && grug_path[mods_root_dir_path_length] == '/', "The grug file '%s' isn't in the mods directory '%s'", grug_path, mods_root_dir_path);
+	grug_assert(streq(get_file_extension(grug_path), ".grug"), "The file '%s' doesn't have the .grug extension", grug_path);
 
-			validate_about_file(about_json_path);
+	// This copy gets cut up into the mod name, the subdirectory names, and the grug filename
+	char relative_path[STUPID_MAX_PATH];
+	grug_assert(snprintf(relative_path, sizeof(relative_path), "%s", grug_path + mods_root_dir_path_length + 1) >= 0, "Filling the variable 'relative_path' failed");
 
-			static char dll_entry_path[STUPID_MAX_PATH];
-			grug_assert(snprintf(dll_entry_path, sizeof(dll_entry_path), "%s/%s", dll_root_dir_path, name) >= 0, "Filling the variable 'dll_entry_path' failed");
+	char *slash = strchr(relative_path, '/');
+	grug_assert(slash, "The grug file '%s' has to be in a mod its directory", grug_path);
+	*slash = '\0';
 
-			// This always returns NULL during the first call of reload_modified_mods()
-			struct grug_mod_dir *subdir = get_subdir(dir, name);
+	const char *mod_name = relative_path;
 
-			if (!subdir) {
-				struct grug_mod_dir inserted_subdir = {.name = strdup(name)};
-				grug_assert(inserted_subdir.name, "strdup: %s", strerror(errno));
-				subdir = push_subdir(dir, inserted_subdir);
-			}
+	struct stat grug_stat;
+	errno = 0;
+	bool grug_file_exists = stat(grug_path, &grug_stat) == 0;
+	grug_assert(grug_file_exists || errno == ENOENT || errno == ENOTDIR, "stat: %s: %s", grug_path, strerror(errno));
+	grug_assert(!grug_file_exists || S_ISREG(grug_stat.st_mode), "'%s' isn't a regular file", grug_path);
 
-			subdir->_seen = true;
+	char dir_path[STUPID_MAX_PATH];
+	grug_assert(snprintf(dir_path, sizeof(dir_path), "%s/%s", mods_root_dir_path, mod_name) >= 0, "Filling the variable 'dir_path' failed");
 
-			reload_modified_mod(entry_path, dll_entry_path, subdir);
-			assert(directory_depth == 0);
+	char dll_dir_path[STUPID_MAX_PATH];
+	grug_assert(snprintf(dll_dir_path, sizeof(dll_dir_path), "%s/%s", dll_root_dir_path, mod_name) >= 0, "Filling the variable 'dll_dir_path' failed");
+
+	mod = mod_name;
+
+	struct grug_mod_dir *dir = get_subdir(&grug_mods, mod_name);
+
+	if (grug_file_exists) {
+		if (!dir) {
+			struct grug_mod_dir inserted_dir = {.name = strdup(mod_name)};
+			grug_assert(inserted_dir.name, "strdup: %s", strerror(errno));
+			dir = push_subdir(&grug_mods, inserted_dir);
 		}
+
+		char about_json_path[STUPID_MAX_PATH];
+		grug_assert(snprintf(about_json_path, sizeof(about_json_path), "%s/about.json", dir_path) >= 0, "Filling the variable 'about_json_path' failed");
+
+		load_about_file(about_json_path, dir);
 	}
-	grug_assert(errno == 0, "readdir: %s", strerror(errno));
 
-	closedir(dirp);
+	char *dir_name = slash + 1;
 
-	// If the directory used to contain a mod that doesn't exist anymore, free it
-	for (size_t i = dir->dirs_size; i > 0;) {
-		i--;
-		if (!dir->dirs[i]._seen) {
-			free_dir(dir->dirs[i]);
-			dir->dirs[i] = dir->dirs[--dir->dirs_size]; // Swap-remove
+	// Walks down to the directory that contains the grug file, creating the directories that are new
+	for (char *next_slash; dir && (next_slash = strchr(dir_name, '/')); dir_name = next_slash + 1) {
+		*next_slash = '\0';
+
+		struct grug_mod_dir *subdir = get_subdir(dir, dir_name);
+
+		if (!subdir && grug_file_exists) {
+			struct grug_mod_dir inserted_subdir = {.name = strdup(dir_name)};
+			grug_assert(inserted_subdir.name, "strdup: %s", strerror(errno));
+			subdir = push_subdir(dir, inserted_subdir);
 		}
-	}
-}
 
-bool grug_init(grug_runtime_error_handler_t handler, const char *mod_api_json_path, const char *mods_dir_path, const char *dll_dir_path, uint64_t on_fn_time_limit_ms_) {
-	if (setjmp(error_jmp_buffer)) {
-		return true;
-	}
+		dir = subdir;
 
-	assert(handler && "grug_init() its grug_runtime_error_handler can't be NULL");
-	grug_runtime_error_handler = handler;
+		directory_depth++;
+		grug_assert(directory_depth < MAX_DIRECTORY_DEPTH, "There is a mod that contains more than %d levels of nested directories", MAX_DIRECTORY_DEPTH);
 
-	assert(!is_grug_initialized && "grug_init() can't be called more than once");
+		size_t dir_path_length = strlen(dir_path);
+		grug_assert(snprintf(dir_path + dir_path_length, sizeof(dir_path) - dir_path_length, "/%s", dir_name) >= 0, "Filling the variable 'dir_path' failed");
 
-	assert(!strchr(mods_dir_path, '\\') && "grug_init() its mods_dir_path can't contain backslashes, so replace them with '/'");
-	assert(mods_dir_path[strlen(mods_dir_path) - 1] != '/' && "grug_init() its mods_dir_path can't have a trailing '/'");
+		size_t dll_dir_path_length = strlen(dll_dir_path);
+		grug_assert(snprintf(dll_dir_path + dll_dir_path_length, sizeof(dll_dir_path) - dll_dir_path_length, "/%s", dir_name) >= 0, "Filling the variable 'dll_dir_path' failed");
+	}
 
-	assert(!strchr(dll_dir_path, '\\') && "grug_init() its dll_dir_path can't contain backslashes, so replace them with '/'");
-	assert(dll_dir_path[strlen(dll_dir_path) - 1] != '/' && "grug_init() its dll_dir_path can't have a trailing '/'");
+	const char *grug_filename = dir_name;
 
-	parse_mod_api_json(mod_api_json_path);
+	if (grug_file_exists) {
+		char dll_entry_path[STUPID_MAX_PATH];
+		grug_assert(snprintf(dll_entry_path, sizeof(dll_entry_path), "%s/%s", dll_dir_path, grug_filename) >= 0, "Filling the variable 'dll_entry_path' failed");
 
-	assert(strlen(mods_dir_path) + 1 <= STUPID_MAX_PATH && "grug_init() its mods_dir_path exceeds the maximum path length");
-	memcpy(mods_root_dir_path, mods_dir_path, strlen(mods_dir_path) + 1);
+		reload_grug_file(dll_entry_path, grug_stat.st_mtime, grug_filename, dir, grug_path);
+	} else if (dir) {
+		struct grug_file *file = get_file(dir, grug_filename);
 
-	assert(strlen(dll_dir_path) + 1 <= STUPID_MAX_PATH && "grug_init() its dll_dir_path exceeds the maximum path length");
-	memcpy(dll_root_dir_path, dll_dir_path, strlen(dll_dir_path) + 1);
+		// The grug file was removed
+		if (file) {
+			remove_file(dir, file - dir->files);
+		}
+	}
 
-	on_fn_time_limit_ms = on_fn_time_limit_ms_;
-	on_fn_time_limit_sec = on_fn_time_limit_ms / MS_PER_SEC;
-	on_fn_time_limit_ns = (on_fn_time_limit_ms % MS_PER_SEC) * NS_PER_MS;
+	directory_depth = 0;
 
-	is_grug_initialized = true;
+	finish_targeted_regeneration();
 
 	return false;
 }
 
-bool grug_regenerate_modified_mods(void) {
+void grug_enable_jit(void) {
+	assert(!grug_mods.name && "grug_enable_jit() has to be called before the first grug_regenerate_modified_mods() call");
+
+	are_dlls_jitted = true;
+	are_dlls_in_memory = false;
+	are_dlls_written_to_disk = false;
+}
+
+bool grug_enable_jit_mod_images(void) {
 	assert(is_grug_initialized && "You forgot to call grug_init() once at program startup!");
+	assert(!grug_mods.name && "grug_enable_jit_mod_images() has to be called before the first grug_regenerate_modified_mods() call");
 
 	if (setjmp(error_jmp_buffer)) {
 		return true;
 	}
 
-	reset_regenerate_modified_mods();
+	grug_enable_jit();
 
-	grug_loading_error_in_grug_file = false;
-
-	if (!grug_mods.name) {
-		grug_mods.name = strdup(get_basename(mods_root_dir_path));
-		grug_assert(grug_mods.name, "strdup: %s", strerror(errno));
+	if (are_jit_mod_images_enabled) {
+		return false;
 	}
 
-	reload_modified_mods();
-
-	check_that_every_entity_exists(grug_mods);
+	grug_assert(mtx_init(&jit_mod_images_mutex, mtx_plain) == thrd_success, "mtx_init() failed");
 
-	reset_previous_grug_error();
+	are_jit_mod_images_enabled = true;
 
 	return false;
 }
 
+void grug_enable_lazy_loading(void) {
+	assert(!grug_mods.name && "grug_enable_lazy_loading() has to be called before the first grug_regenerate_modified_mods() call");
+	assert(!is_background_regeneration_enabled && "grug_enable_lazy_loading() can't be used together with grug_enable_background_regeneration()");
+
+	is_lazy_loading_enabled = true;
+}
+
+void grug_enable_optimizations(void) {
+	assert(!grug_mods.name && "grug_enable_optimizations() has to be called before the first grug_regenerate_modified_mods() call");
+
+	are_optimizations_enabled = true;
+}
+
+void grug_enable_in_memory_dlls(bool write_dlls_to_disk) {
+	are_dlls_in_memory = true;
+	are_dlls_written_to_disk = write_dlls_to_disk;
+}
+
+void grug_enable_build_cache(void) {
+	is_build_cache_enabled = true;
+}
+
+void grug_set_compilation_thread_count(size_t thread_count) {
+	compilation_thread_count = thread_count;
+}
+
 USED_BY_MODS bool grug_has_runtime_error_happened = false;
 void grug_game_function_error_happened(const char *message) {
 	grug_has_runtime_error_happened = true;